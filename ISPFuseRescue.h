@@ -14,13 +14,44 @@
 // Enable either the FuseRecue or ArduinoISP by A0 signal.
 // ArduinoISP sketch was captured by the .cpp file from the original code that
 // is in the example of Arduino IDE and it was capsuled in the namespace as
-// ArduinoISP. The original logic has not been modified.
+// ArduinoISP. It has been extended with STK500v2 and the faster programming,
+// the STK500v1 protocol is still compatible with the original.
 
 #include "ArduinoISP.h"
 #include "FuseRescue.h"
 
 #define ACTMODE		A0
 
+// Error limit of the serial baud rate in 0.1% unit.
+// 115200 and 57600 are +2.1% at 16MHz, they are still tolerated as the USB
+// bridge 16U2 runs on the same clock and divisor.
+#define BAUD_ERROR_LIMIT	25
+
+// UBRR and the speed mode which HardwareSerial applies, and the error of
+// the actual baud rate in 0.1% unit. HardwareSerial takes the double
+// speed mode except for 57600 at 16MHz, which is kept on the single speed
+// for the bootloader of the older boards and the firmware of the 8U2, and
+// for the UBRR over 12 bits.
+constexpr bool serial_single(uint32_t baud) {
+	return (F_CPU == 16000000UL && baud == 57600) || (F_CPU / 4 / baud - 1) / 2 > 4095;
+}
+constexpr uint16_t serial_ubrr(uint32_t baud) {
+	return serial_single(baud) ? (F_CPU / 8 / baud - 1) / 2 : (F_CPU / 4 / baud - 1) / 2;
+}
+constexpr int32_t serial_error(uint32_t baud) {
+	return ((int32_t)(F_CPU / (serial_single(baud) ? 16 : 8) / (serial_ubrr(baud) + 1)) - (int32_t)baud) * 1000 / (int32_t)baud;
+}
+constexpr bool serial_valid(const uint32_t *rates, uint8_t n) {
+	return n == 0 || (serial_error(*rates) <= BAUD_ERROR_LIMIT &&
+		serial_error(*rates) >= -BAUD_ERROR_LIMIT && serial_valid(rates + 1, n - 1));
+}
+constexpr uint32_t	ISP_RATES[] = { ISP_BAUDRATE, ISP_BAUD_RATES };
+constexpr uint32_t	FUSERESCUE_RATES[] = { FUSERESCUE_BAUDRATE, FUSERESCUE_BAUD_RATES };
+static_assert(serial_valid(ISP_RATES, sizeof ISP_RATES / sizeof(uint32_t)),
+	"ArduinoISP baud rate can not be generated accurately");
+static_assert(serial_valid(FUSERESCUE_RATES, sizeof FUSERESCUE_RATES / sizeof(uint32_t)),
+	"FuseRescue baud rate can not be generated accurately");
+
 typedef enum {
 	PCB_FUSERESCUE,
 	PCB_ARDUINOISP
@@ -11,12 +11,15 @@
 // Enable either the FuseRecue or ArduinoISP by A0 signal.
 // ArduinoISP sketch was captured by the .cpp file from the original code that
 // is in the example of Arduino IDE and it was capsuled in the namespace as
-// ArduinoISP. The original logic has not been modified.
+// ArduinoISP. It has been extended with STK500v2 and the faster programming,
+// the STK500v1 protocol is still compatible with the original.
 
 #include <Arduino.h>
 #include <MsTimer2.h>
 #include "FuseRescue.h"
 #include "ArduinoISP.h"
+#include "SramArena.h"
+#include "PinTrace.h"
 #include "ISPFuseRescue.h"
 
 // Current function of PCB
@@ -42,12 +45,14 @@ PCBFUNC sense_pcb(void) {
 	// Release the mode sense pin, turn off target chip.
 	digitalWrite(VCC_ENABLE, LOW);
 	// Stop completely the target chip waiting for discharge of the capacitor.
-	delay(100);
+	delay(PGM_DISCHARGE);
 
 	return pcbSelection;
 }
 
 void setup() {
+	// Paint the unused SRAM to take the high-water mark of the mode
+	SramArena::paint();
 	// Operation mode selection
 	switch (PCBMODE = sense_pcb()) {
 	case PCB_ARDUINOISP:
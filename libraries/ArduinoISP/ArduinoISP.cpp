@@ -44,6 +44,8 @@
 // - More information at http://code.google.com/p/mega-isp
 
 #include "ArduinoISP.h"
+#include <util/crc16.h>
+#include "STK500v2.h"
 
 parameter param;
 
@@ -51,7 +53,10 @@ int	ArduinoISP::error = 0;
 int	ArduinoISP::pmode = 0;
 // address for reading and writing, set by 'U' command
 int	ArduinoISP::here;
-uint8_t	ArduinoISP::buff[256]; // global block storage
+uint8_t	*ArduinoISP::buff; // global block storage, claimed from the arena
+// a page of all 0xFF needs no programming after chip erase
+bool	ArduinoISP::erased;
+uint16_t	ArduinoISP::skipped_pages;
 
 // this provides a heartbeat on pin 9, so you can tell the software is running.
 uint8_t ArduinoISP::hbval = 128;
@@ -66,8 +71,11 @@ void ArduinoISP::pulse(int pin, int times) {
 	} while (times--);
 }
 
+// buff is indexed by a byte, the ring of receive_ahead wraps at 256
+static_assert(256 <= SRAM_ARENA_SIZE, "ArduinoISP buff exceeds SRAM_ARENA_SIZE");
 void ArduinoISP::setup() {
-	Serial.begin(19200);
+	buff = (uint8_t *)SramArena::claim(256);
+	Serial.begin(ISP_BAUDRATE);
 	pinMode(LED_PMODE, OUTPUT);
 	pulse(LED_PMODE, 2);
 	pinMode(LED_ERR, OUTPUT);
@@ -81,24 +89,48 @@ void ArduinoISP::heartbeat() {
 	if (hbval < 32) hbdelta = -hbdelta;
 	hbval += hbdelta;
 	analogWrite(LED_HB, hbval);
-	delay(20);
 }
 
-void ArduinoISP::loop(void) {
+void ArduinoISP::status_leds() {
 	// is pmode active?
 	if (pmode) digitalWrite(LED_PMODE, HIGH);
 	else digitalWrite(LED_PMODE, LOW);
 	// is there an error?
 	if (error) digitalWrite(LED_ERR, HIGH);
 	else digitalWrite(LED_ERR, LOW);
+}
 
-	// light the heartbeat LED
-	heartbeat();
+void ArduinoISP::protocol() {
 	if (Serial.available()) {
 		avrisp();
 	}
 }
 
+// cooperative tasks, each runs when (period) ms has elapsed since its
+// last run. no task waits, so a command is taken within the processing
+// time of the other tasks instead of the heartbeat animation.
+typedef struct {
+	void (*run)();
+	uint8_t period;
+	unsigned long last;
+} task;
+
+static task tasks[] = {
+	{ ArduinoISP::protocol,    0,      0 },
+	{ ArduinoISP::status_leds, 0,      0 },
+	{ ArduinoISP::heartbeat,   HBTIME, 0 },
+};
+
+void ArduinoISP::loop(void) {
+	for (uint8_t i = 0; i < sizeof(tasks) / sizeof(tasks[0]); i++) {
+		unsigned long now = millis();
+		if (now - tasks[i].last >= tasks[i].period) {
+			tasks[i].last = now;
+			tasks[i].run();
+		}
+	}
+}
+
 uint8_t ArduinoISP::getch() {
 	while (!Serial.available());
 	return Serial.read();
@@ -118,10 +150,89 @@ void ArduinoISP::prog_lamp(int state) {
 void ArduinoISP::spi_init() {
 	uint8_t	x;
 	SPCR = 0x53;
+	SPSR = 0;
 	x = SPSR;
 	x = SPDR;
 }
 
+// SPI clock from the fastest, SPR1:SPR0 with SPI2X at bit 7
+// fosc/4, /8, /16, /32, /64, /128
+static const uint8_t spi_rates[SPI_RATES] = { 0x00, 0x81, 0x01, 0x82, 0x02, 0x03 };
+// SCK duration set by STK_SET_PARAMETER, 0 means calibration
+uint8_t ArduinoISP::sck_duration = 0;
+
+void ArduinoISP::spi_rate(uint8_t rate) {
+	SPCR = 0x50 | (spi_rates[rate] & 0x03);
+	SPSR = (spi_rates[rate] & 0x80) ? (1 << SPI2X) : 0;
+}
+
+// Programming Enable must echo 0x53 at the third byte,
+// and read the signature at the current rate
+bool ArduinoISP::spi_check(uint32_t *sig) {
+	uint8_t echo;
+	spi_send(0xAC);
+	spi_send(0x53);
+	echo = spi_send(0x00);
+	spi_send(0x00);
+	*sig = 0;
+	for (uint8_t i = 0; i < 3; i++)
+		*sig = (*sig << 8) | spi_transaction(0x30, 0x00, i, 0x00);
+	return echo == 0x53;
+}
+
+// Pulse RESET with SCK low and enter Programming mode again, a target
+// which lost the byte framing at a too fast SCK gets back in step.
+bool ArduinoISP::spi_reenter() {
+	uint32_t sig;
+	digitalWrite(SCK, LOW);
+	digitalWrite(RESET, HIGH);
+	TRACE_LEVEL(TRACE_RESET, HIGH);
+	delayMicroseconds(100);
+	digitalWrite(RESET, LOW);
+	TRACE_LEVEL(TRACE_RESET, LOW);
+	delay(25);
+	return spi_check(&sig);
+}
+
+// Find the fastest SCK which is reliable for the target.
+// The signature at the slowest rate is the reference, a target on the
+// internal 1MHz RC still works at the slowest rate. A failed rate can
+// leave the target out of step, so it re-enters Programming mode at the
+// slowest rate before the next one. The rate one step slower than the
+// fastest passing one is taken, a rate at the limit of fck/4 may pass
+// the checks and still corrupt a byte now and then.
+void ArduinoISP::spi_calibrate() {
+	uint8_t rate = SPI_RATES - 1;
+	uint32_t ref, sig;
+	if (sck_duration) {
+		// forced by the SCK duration of STK500, 1 unit is 8 / 7.3728MHz
+		// (about 1085ns). take the fastest divider not shorter than it.
+		uint32_t period = sck_duration * 1085UL;
+		for (rate = 0; rate < SPI_RATES - 1; rate++)
+			if ((4000UL << rate) / (F_CPU / 1000000UL) >= period) break;
+	}
+	else if (spi_check(&ref) && ref != 0 && ref != 0xFFFFFF) {
+		for (uint8_t r = 0; r < SPI_RATES - 1; r++) {
+			uint8_t n;
+			spi_rate(r);
+			for (n = 0; n < SPI_CHECKS; n++)
+				if (!spi_check(&sig) || sig != ref) break;
+			if (n == SPI_CHECKS) {
+				rate = r + 1;
+				break;
+			}
+			spi_rate(SPI_RATES - 1);
+			spi_reenter();
+		}
+	}
+	// enter again at the rate to be used, the slowest if it fails
+	spi_rate(rate);
+	if (!spi_reenter()) {
+		spi_rate(SPI_RATES - 1);
+		spi_reenter();
+	}
+}
+
 void ArduinoISP::spi_wait() {
 	do {
 	} while (!(SPSR & (1 << SPIF)));
@@ -137,11 +248,90 @@ uint8_t	ArduinoISP::spi_send(uint8_t b) {
 
 uint8_t ArduinoISP::spi_transaction(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
 	uint8_t n;
+	TRACE(TRACE_SPI_OUT, a);
 	spi_send(a);
 	n = spi_send(b);
 	//if (n != a) error = -1;
 	n = spi_send(c);
-	return spi_send(d);
+	n = spi_send(d);
+	TRACE(TRACE_SPI_IN, n);
+	return n;
+}
+
+// parts which implement Poll RDY/BSY (0xF0) and the EEPROM page access
+// (0xC1, 0xC2), and their Flash page by words, by the signature bytes
+// following 0x1E. an older part as the ATmega8 answers the instruction it
+// lacks with the echo, which reads as ready while it is still busy, so an
+// unknown part is not polled and its EEPROM is written byte by byte
+// whatever the parameters say. STK500v2 takes the Flash page from here.
+#define PART_POLL 0x01
+#define PART_EEPAGE 0x02
+typedef struct {
+	uint16_t sig;
+	uint8_t caps;
+	uint8_t page;
+} part;
+
+static const part parts[] PROGMEM = {
+	{ 0x9205, PART_POLL | PART_EEPAGE, 32 }, // ATmega48
+	{ 0x920A, PART_POLL | PART_EEPAGE, 32 }, // ATmega48P
+	{ 0x930A, PART_POLL | PART_EEPAGE, 32 }, // ATmega88
+	{ 0x930F, PART_POLL | PART_EEPAGE, 32 }, // ATmega88P
+	{ 0x9406, PART_POLL | PART_EEPAGE, 64 }, // ATmega168
+	{ 0x940B, PART_POLL | PART_EEPAGE, 64 }, // ATmega168P
+	{ 0x9514, PART_POLL | PART_EEPAGE, 64 }, // ATmega328
+	{ 0x950F, PART_POLL | PART_EEPAGE, 64 }, // ATmega328P
+	{ 0x940A, PART_POLL | PART_EEPAGE, 64 }, // ATmega164P
+	{ 0x9508, PART_POLL | PART_EEPAGE, 64 }, // ATmega324P
+	{ 0x960A, PART_POLL | PART_EEPAGE, 128 }, // ATmega644P
+	{ 0x9705, PART_POLL | PART_EEPAGE, 128 }, // ATmega1284P
+	{ 0x9608, PART_POLL | PART_EEPAGE, 128 }, // ATmega640
+	{ 0x9703, PART_POLL | PART_EEPAGE, 128 }, // ATmega1280
+	{ 0x9801, PART_POLL | PART_EEPAGE, 128 }, // ATmega2560
+	{ 0x9587, PART_POLL | PART_EEPAGE, 64 }, // ATmega32U4
+	{ 0x910A, PART_POLL, 16 }, // ATtiny2313
+	{ 0x910B, PART_POLL | PART_EEPAGE, 16 }, // ATtiny24
+	{ 0x9207, PART_POLL | PART_EEPAGE, 32 }, // ATtiny44
+	{ 0x930C, PART_POLL | PART_EEPAGE, 32 }, // ATtiny84
+	{ 0x9108, PART_POLL | PART_EEPAGE, 16 }, // ATtiny25
+	{ 0x9206, PART_POLL | PART_EEPAGE, 32 }, // ATtiny45
+	{ 0x930B, PART_POLL | PART_EEPAGE, 32 }, // ATtiny85
+	{ 0x9307, 0, 32 }, // ATmega8
+};
+
+// capabilities of the target in this session
+static uint8_t part_caps;
+uint8_t ArduinoISP::part_page;
+
+static const part *find_part(uint32_t sig) {
+	if ((sig >> 16) != 0x1E) return NULL;
+	for (uint8_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++)
+		if (pgm_read_word(&parts[i].sig) == (uint16_t)sig)
+			return &parts[i];
+	return NULL;
+}
+
+// wait for the completion of programming by Poll RDY/BSY (0xF0).
+// the polling is bounded by (ms) that is the fixed delay for the parts
+// which lack polling. if the target never gets ready within it, polling
+// is given up for the rest of session and the fixed delay is used.
+static bool rdy_poll;
+
+void ArduinoISP::wait_ready(uint8_t ms) {
+	TRACE(TRACE_BEGIN, TRACE_PHASE_WAIT);
+	if (!rdy_poll) {
+		delay(ms);
+		TRACE(TRACE_END, TRACE_PHASE_WAIT);
+		return;
+	}
+	unsigned long start = millis();
+	while (spi_transaction(0xF0, 0x00, 0x00, 0x00) & 0x01) {
+		if (millis() - start > ms) {
+			rdy_poll = false;
+			break;
+		}
+	}
+	TRACE(TRACE_END, TRACE_PHASE_WAIT);
 }
 
 void ArduinoISP::empty_reply() {
@@ -181,11 +371,47 @@ void ArduinoISP::get_version(uint8_t c) {
 	case 0x93:
 		breply('S'); // serial programmer
 		break;
+	case Parm_STK_SCK_DURATION:
+		breply(sck_duration);
+		break;
+	case Parm_ISP_SKIPPED_LO:
+		breply(skipped_pages & 0xFF);
+		break;
+	case Parm_ISP_SKIPPED_HI:
+		breply(skipped_pages >> 8);
+		break;
+	case Parm_ISP_SRAM_LO:
+		breply(SramArena::high_water() & 0xFF);
+		break;
+	case Parm_ISP_SRAM_HI:
+		breply(SramArena::high_water() >> 8);
+		break;
 	default:
 		breply(0);
 	}
 }
 
+static const uint32_t baud_rates[] PROGMEM = { ISP_BAUD_RATES };
+
+void ArduinoISP::set_parameter() {
+	uint8_t p = getch();
+	uint8_t v = getch();
+	// SCK duration, 0 restores the calibration
+	if (p == Parm_STK_SCK_DURATION) sck_duration = v;
+	if (p == Parm_ISP_BAUD && v >= sizeof(baud_rates) / sizeof(baud_rates[0])) {
+		error++;
+		if (CRC_EOP == getch()) Serial.print((char)STK_FAILED);
+		else Serial.print((char)STK_NOSYNC);
+		return;
+	}
+	empty_reply();
+	// the new baud rate takes effect after the reply has gone
+	if (p == Parm_ISP_BAUD) {
+		Serial.flush();
+		Serial.begin(pgm_read_dword(&baud_rates[v]));
+	}
+}
+
 void ArduinoISP::set_parameters() {
 	// call this after reading paramter packet into buff[]
 	param.devicecode = buff[0];
@@ -209,19 +435,44 @@ void ArduinoISP::set_parameters() {
 	+ buff[19];
 }
 
+void ArduinoISP::set_ext_parameters() {
+	// call this after reading extended parameter packet into buff[]
+	// buff[0] is the number of parameters including itself
+	param.eepagesize = buff[0] > 1 ? buff[1] : 0;
+	// page size must be a power of 2, fall back to byte writing otherwise
+	if (param.eepagesize & (param.eepagesize - 1)) param.eepagesize = 0;
+}
+
 void ArduinoISP::start_pmode() {
+	TRACE(TRACE_BEGIN, TRACE_PHASE_PMODE);
 	spi_init();
 	// following delays may not work on all targets...
 	pinMode(RESET, OUTPUT);
 	digitalWrite(RESET, HIGH);
+	TRACE_LEVEL(TRACE_RESET, HIGH);
 	pinMode(SCK, OUTPUT);
 	digitalWrite(SCK, LOW);
 	delay(50);
 	digitalWrite(RESET, LOW);
+	TRACE_LEVEL(TRACE_RESET, LOW);
 	delay(50);
 	pinMode(MISO, INPUT);
 	pinMode(MOSI, OUTPUT);
 	spi_transaction(0xAC, 0x53, 0x00, 0x00);
+	spi_calibrate();
+	TRACE(TRACE_END, TRACE_PHASE_PMODE);
+	uint32_t sig;
+	spi_check(&sig);
+	const part *p = find_part(sig);
+	part_caps = p ? pgm_read_byte(&p->caps) : 0;
+	part_page = p ? pgm_read_byte(&p->page) : 0;
+	rdy_poll = part_caps & PART_POLL;
+	// avrdude enters again after the chip erase, the session goes on
+	// until 'Q' and keeps the erased state
+	if (!pmode) {
+		erased = false;
+		skipped_pages = 0;
+	}
 	pmode = 1;
 }
 
@@ -230,6 +481,7 @@ void ArduinoISP::end_pmode() {
 	pinMode(MOSI, INPUT);
 	pinMode(SCK, INPUT);
 	pinMode(RESET, INPUT);
+	TRACE_LEVEL(TRACE_RESET, HIGH);
 	pmode = 0;
 }
 
@@ -238,6 +490,7 @@ void ArduinoISP::universal() {
 	uint8_t ch;
 	fill(4);
 	ch = spi_transaction(buff[0], buff[1], buff[2], buff[3]);
+	if (buff[0] == 0xAC && buff[1] == 0x80) erased = true; // chip erase
 	breply(ch);
 }
 
@@ -251,10 +504,8 @@ void ArduinoISP::flash(uint8_t hilo, int addr, uint8_t data) {
 void ArduinoISP::commit(int addr) {
 	if (PROG_FLICKER) prog_lamp(LOW);
 	spi_transaction(0x4C, (addr >> 8) & 0xFF, addr & 0xFF, 0);
-	if (PROG_FLICKER) {
-		delay(PTIME);
-		prog_lamp(HIGH);
-	}
+	wait_ready(PTIME);
+	if (PROG_FLICKER) prog_lamp(HIGH);
 }
 
 //#define _current_page(x) (here & 0xFFFFE0)
@@ -267,10 +518,18 @@ int ArduinoISP::current_page(int addr) {
 }
 
 void ArduinoISP::write_flash(int length) {
-	fill(length);
+	// The page data is not filled in advance, write_flash_pages() loads
+	// each word as soon as it arrives. The last page is committed only
+	// after CRC_EOP, so a broken command leaves it unwritten. The pages
+	// before it are written already if the command covers several pages,
+	// avrdude sends a page at a time.
+	bool blank;
+	int page = write_flash_pages(length, &blank);
 	if (CRC_EOP == getch()) {
+		if (erased && blank) skipped_pages++;
+		else commit(page);
 		Serial.print((char) STK_INSYNC);
-		Serial.print((char) write_flash_pages(length));
+		Serial.print((char) STK_OK);
 	}
 	else {
 		error++;
@@ -278,20 +537,45 @@ void ArduinoISP::write_flash(int length) {
 	}
 }
 
-uint8_t ArduinoISP::write_flash_pages(int length) {
+// Move the bytes which have already arrived from the serial ring (64
+// bytes) into buff used as a ring of 256 bytes, at least until the byte
+// (x) is there. (rx) of (length) bytes have been received by (get), the
+// new count is returned. Called before each byte is clocked into the
+// target, the reception overlaps with the SPI transactions without
+// overrunning the serial ring even when the serial is faster than SCK.
+uint16_t ArduinoISP::receive_ahead(uint16_t rx, uint16_t x, uint16_t length, uint8_t (*get)()) {
+	while (rx < length && rx - x < 256 && (rx <= x || Serial.available()))
+		buff[rx++ & 0xFF] = get();
+	return rx;
+}
+
+// Receive the page data and load it word by word, see receive_ahead().
+// Each page is committed when the next one begins, the last one is left
+// to the caller with (blank) set if all of it is 0xFF, its page address
+// is returned. After chip erase, the commit of a blank page is skipped.
+// Its loading costs nothing since it overlaps with the reception anyway.
+int ArduinoISP::write_flash_pages(int length, bool *blank_page) {
 	int x = 0;
+	int rx = 0;
 	int page = current_page(here);
+	bool blank = true;
 	while (x < length) {
 		if (page != current_page(here)) {
-			commit(page);
+			if (erased && blank) skipped_pages++;
+			else commit(page);
 			page = current_page(here);
+			blank = true;
 		}
-		flash(LOW, here, buff[x++]);
-		flash(HIGH, here, buff[x++]);
+		rx = receive_ahead(rx, x, length, getch);
+		flash(LOW, here, buff[x & 0xFF]);
+		blank &= buff[x++ & 0xFF] == 0xFF;
+		rx = receive_ahead(rx, x, length, getch);
+		flash(HIGH, here, buff[x & 0xFF]);
+		blank &= buff[x++ & 0xFF] == 0xFF;
 		here++;
 	}
-	commit(page);
-	return STK_OK;
+	*blank_page = blank;
+	return page;
 }
 
 #define EECHUNK (32)
@@ -314,14 +598,30 @@ uint8_t ArduinoISP::write_eeprom(int length) {
 
 // write (length) bytes, (start) is a byte address
 uint8_t ArduinoISP::write_eeprom_chunk(int start, int length) {
-	// this writes byte-by-byte,
-	// page writing may be faster (4 bytes at a time)
+	// this writes page-by-page if the extended parameters gave the
+	// EEPROM page size of a part which has the page access, otherwise
+	// byte-by-byte
 	fill(length);
 	prog_lamp(LOW);
-	for (int x = 0; x < length; x++) {
-		int addr = start + x;
-		spi_transaction(0xC0, (addr >> 8) & 0xFF, addr & 0xFF, buff[x]);
-		delay(45);
+	if (param.eepagesize > 1 && (part_caps & PART_EEPAGE)) {
+		uint8_t mask = param.eepagesize - 1;
+		for (int x = 0; x < length; x++) {
+			int addr = start + x;
+			// load EEPROM memory page, only loaded bytes are altered
+			spi_transaction(0xC1, 0x00, addr & mask, buff[x]);
+			if ((addr & mask) == mask || x == length - 1) {
+				// write EEPROM memory page
+				spi_transaction(0xC2, (addr >> 8) & 0xFF, addr & ~mask & 0xFF, 0x00);
+				wait_ready(EETIME);
+			}
+		}
+	}
+	else {
+		for (int x = 0; x < length; x++) {
+			int addr = start + x;
+			spi_transaction(0xC0, (addr >> 8) & 0xFF, addr & 0xFF, buff[x]);
+			wait_ready(EETIME);
+		}
 	}
 	prog_lamp(HIGH);
 	return STK_OK;
@@ -359,25 +659,42 @@ uint8_t ArduinoISP::flash_read(uint8_t hilo, int addr) {
 							addr & 0xFF,
 							0);
 }
-char ArduinoISP::flash_read_page(int length) {
-	for (int x = 0; x < length; x += 2) {
-		uint8_t low = flash_read(LOW, here);
-		Serial.print((char) low);
-		uint8_t high = flash_read(HIGH, here);
-		Serial.print((char) high);
-		here++;
+// read a page into buff by SPI and send it. the bytes already read are
+// handed to the TX ring of HardwareSerial as far as it has room, and its
+// UDRE interrupt drains them while the rest is read, so a page takes the
+// longer of SPI and UART rather than their sum. the tail of the page is
+// still draining when this returns. (addr) is a byte address.
+// returns the xor of the sent bytes for the STK500v2 checksum.
+uint8_t ArduinoISP::send_page(char memtype, uint32_t addr, int length) {
+	uint8_t sum = 0;
+	while (length > 0) {
+		int n = length < 256 ? length : 256;
+		int sent = 0;
+		for (int x = 0; x < n; x++) {
+			sum ^= buff[x] = read_byte(memtype, addr++);
+			int room = Serial.availableForWrite();
+			if (room > x + 1 - sent) room = x + 1 - sent;
+			if (room > 0) {
+				Serial.write(buff + sent, room);
+				sent += room;
+			}
+		}
+		// buff is refilled only after the ring has taken the whole chunk
+		Serial.write(buff + sent, n - sent);
+		length -= n;
 	}
+	return sum;
+}
+
+char ArduinoISP::flash_read_page(int length) {
+	send_page('F', (uint32_t)here * 2, length);
+	here += length / 2;
 	return STK_OK;
 }
 
 char ArduinoISP::eeprom_read_page(int length) {
 	// here again we have a word address
-	int start = here * 2;
-	for (int x = 0; x < length; x++) {
-		int addr = start + x;
-		uint8_t ee = spi_transaction(0xA0, (addr >> 8) & 0xFF, addr & 0xFF, 0xFF);
-		Serial.print((char) ee);
-	}
+	send_page('E', (uint32_t)here * 2, length);
 	return STK_OK;
 }
 
@@ -414,6 +731,73 @@ void ArduinoISP::read_signature() {
 	Serial.print((char) STK_OK);
 }
 
+// read a byte of flash or EEPROM at the byte address
+uint8_t ArduinoISP::read_byte(char memtype, uint32_t addr) {
+	if (memtype == 'F') return flash_read(addr & 1, addr >> 1);
+	return spi_transaction(0xA0, (addr >> 8) & 0xFF, addr & 0xFF, 0xFF);
+}
+
+// compute the checksum of a flash or EEPROM range on the programmer
+// and reply only the checksum instead of the memory contents.
+// z, memtype('F'/'E'), width(2/4), start(4), length(4), CRC_EOP
+// width 2 is CRC-16/XMODEM, 4 is CRC-32 (IEEE 802.3). start and length
+// are byte counts in big endian, the checksum is replied in big endian.
+void ArduinoISP::read_crc() {
+	fill(10);
+	char memtype = buff[0];
+	uint8_t width = buff[1];
+	uint32_t addr = 0, length = 0;
+	for (uint8_t i = 0; i < 4; i++) {
+		addr = (addr << 8) | buff[2 + i];
+		length = (length << 8) | buff[6 + i];
+	}
+	if (CRC_EOP != getch()) {
+		error++;
+		Serial.print((char) STK_NOSYNC);
+		return;
+	}
+	Serial.print((char) STK_INSYNC);
+	if ((memtype != 'F' && memtype != 'E') || (width != 2 && width != 4)) {
+		Serial.print((char) STK_FAILED);
+		return;
+	}
+	uint32_t crc = width == 2 ? 0 : 0xFFFFFFFF;
+	while (length--) {
+		uint8_t data = read_byte(memtype, addr++);
+		if (width == 2) {
+			crc = _crc_xmodem_update(crc, data);
+		}
+		else {
+			crc ^= data;
+			for (uint8_t i = 0; i < 8; i++)
+				crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320 : 0);
+		}
+	}
+	if (width == 4) {
+		crc = ~crc;
+		Serial.print((char) (crc >> 24));
+		Serial.print((char) (crc >> 16));
+	}
+	Serial.print((char) (crc >> 8));
+	Serial.print((char) crc);
+	Serial.print((char) STK_OK);
+}
+
+#ifdef PINTRACE
+// dump the recorded events of PinTrace between STK_INSYNC and STK_OK.
+// y, CRC_EOP
+void ArduinoISP::read_trace() {
+	if (CRC_EOP != getch()) {
+		error++;
+		Serial.print((char) STK_NOSYNC);
+		return;
+	}
+	Serial.print((char) STK_INSYNC);
+	PinTrace::dump();
+	Serial.print((char) STK_OK);
+}
+#endif
+
 //////////////////////////////////////////
 //////////////////////////////////////////
 ////////////////////////////////////
@@ -436,13 +820,17 @@ int ArduinoISP::avrisp() {
 	case 'A':
 		get_version(getch());
 		break;
+	case '@': // set parameter
+		set_parameter();
+		break;
 	case 'B':
 		fill(20);
 		set_parameters();
 		empty_reply();
 		break;
-	case 'E': // extended parameters - ignore for now
+	case 'E': // extended parameters
 		fill(5);
+		set_ext_parameters();
 		empty_reply();
 		break;
 	case 'P':
@@ -480,6 +868,17 @@ int ArduinoISP::avrisp() {
 	case 0x75: //STK_READ_SIGN 'u'
 		read_signature();
 		break;
+	case STK_READ_CRC: // 'z'
+		read_crc();
+		break;
+#ifdef PINTRACE
+	case STK_READ_TRACE: // 'y'
+		read_trace();
+		break;
+#endif
+	case MESSAGE_START: // STK500v2
+		stk500v2();
+		break;
 	// expecting a command, not CRC_EOP
 	// this is how we can get back in sync
 	case CRC_EOP:
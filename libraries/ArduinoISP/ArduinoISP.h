@@ -8,6 +8,8 @@
 
 #include "Arduino.h"
 #include "pins_arduino.h"
+#include "SramArena.h"
+#include "PinTrace.h"
 
 #define RESET     SS
 
@@ -16,6 +18,13 @@
 #define LED_PMODE 7
 #define PROG_FLICKER true
 
+// Serial baud rate at startup, and the rates which can be switched to at
+// runtime by STK_SET_PARAMETER with Parm_ISP_BAUD as the index of the list.
+#ifndef ISP_BAUDRATE
+#define ISP_BAUDRATE 19200
+#endif
+#define ISP_BAUD_RATES 19200, 38400, 57600, 115200, 250000, 500000, 1000000
+
 #define HWVER 2
 #define SWMAJ 1
 #define SWMIN 18
@@ -27,6 +36,21 @@
 #define STK_INSYNC  0x14
 #define STK_NOSYNC  0x15
 #define CRC_EOP     0x20 //ok it is a space...
+#define STK_READ_CRC 0x7A       // not of STK500, 'z' checksum of a range
+#define STK_READ_TRACE 0x79     // not of STK500, 'y' dump of PinTrace
+#define Parm_STK_SCK_DURATION 0x89
+#define Parm_ISP_BAUD         0xA0 // not of STK500, switches the baud rate
+#define Parm_ISP_SKIPPED_LO   0xA1 // not of STK500, skipped blank pages
+#define Parm_ISP_SKIPPED_HI   0xA2
+#define Parm_ISP_SRAM_LO      0xA3 // not of STK500, SRAM high-water mark
+#define Parm_ISP_SRAM_HI      0xA4
+
+// SPI clock calibration
+// SCK is tried from fosc/4 to fosc/128, each rate passes when
+// Programming Enable echoes and the signature matches SPI_CHECKS times,
+// and the rate one step slower than the first passing one is used.
+#define SPI_RATES   6
+#define SPI_CHECKS  8
 
 #define beget16(addr) (*addr * 256 + *(addr+1) )
 typedef struct param {
@@ -43,14 +67,21 @@ typedef struct param {
 	int		pagesize;
 	int		eepromsize;
 	int		flashsize;
+	uint8_t	eepagesize;		// set by extended parameters, 0 means byte writing
 } parameter;
 #define PTIME 30
+#define HBTIME 20	// heartbeat step period
+#define EETIME 45	// fixed wait of EEPROM byte writing without polling
 
 namespace ArduinoISP {
 	extern int	error;
 	extern int	pmode;
 	extern int	here;						// address for reading and writing, set by 'U' command
-	extern uint8_t	buff[];					// global block storage
+	extern uint8_t	*buff;					// global block storage, 256 bytes of the arena
+	extern bool		erased;					// chip erased in this session
+	extern uint16_t	skipped_pages;			// blank pages not programmed
+	extern uint8_t	sck_duration;			// SCK duration, 0 means calibration
+	extern uint8_t	part_page;				// Flash page of the target by words, 0 if unknown
 
 	extern uint8_t	hbval;
 	extern int8_t	hbdelta;
@@ -58,18 +89,27 @@ namespace ArduinoISP {
 	void	pulse(int pin, int times);
 	void	setup(void);
 	void	heartbeat(void);
+	void	status_leds(void);
+	void	protocol(void);
 	void	loop(void);
 	uint8_t	getch();
 	void	fill(int n);
 	void	prog_lamp(int state);
 	void	spi_init();
+	void	spi_rate(uint8_t rate);
+	bool	spi_check(uint32_t *sig);
+	bool	spi_reenter();
+	void	spi_calibrate();
 	void	spi_wait();
 	uint8_t	spi_send(uint8_t b);
 	uint8_t	spi_transaction(uint8_t a, uint8_t b, uint8_t c, uint8_t d);
+	void	wait_ready(uint8_t ms);
 	void	empty_reply();
 	void	breply(uint8_t b);
 	void	get_version(uint8_t c);
+	void	set_parameter();
 	void	set_parameters();
+	void	set_ext_parameters();
 	void	start_pmode();
 	void	end_pmode();
 	void	universal();
@@ -77,7 +117,8 @@ namespace ArduinoISP {
 	void	commit(int addr);
 	int		current_page(int addr);
 	void	write_flash(int length);
-	uint8_t	write_flash_pages(int length);
+	uint16_t	receive_ahead(uint16_t rx, uint16_t x, uint16_t length, uint8_t (*get)());
+	int		write_flash_pages(int length, bool *blank_page);
 	uint8_t	write_eeprom(int length);
 	uint8_t	write_eeprom_chunk(int start, int length);
 	void	program_page();
@@ -86,7 +127,18 @@ namespace ArduinoISP {
 	char	eeprom_read_page(int length);
 	void	read_page();
 	void	read_signature();
+	uint8_t	read_byte(char memtype, uint32_t addr);
+	uint8_t	send_page(char memtype, uint32_t addr, int length);
+	void	read_crc();
+#ifdef PINTRACE
+	void	read_trace();
+#endif
 	int		avrisp();
+	// STK500v2 protocol engine
+	void	stk500v2();
+	void	v2_answer(uint8_t cmd, uint8_t status);
+	void	v2_program(uint8_t cmd);
+	void	v2_read(uint8_t cmd);
 };
 
 #endif	/* __ARDUINOISP_H_ */
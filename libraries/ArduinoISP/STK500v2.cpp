@@ -0,0 +1,420 @@
+// STK500v2 protocol engine for ArduinoISP
+// This is a part of ArduinoISP, the license follows ArduinoISP.cpp.
+//
+// This speaks the avrispv2 dialect of STK500v2 with the same SPI
+// functions as the STK500v1 engine in ArduinoISP.cpp. A message is
+// detected by MESSAGE_START at the place of a STK500v1 command, so
+// avrdude can use either "-c stk500v1" or "-c stk500v2".
+//
+// A message is MESSAGE_START, sequence, size (2), TOKEN, body, checksum.
+// The checksum is the XOR of all the preceding bytes of the message.
+// The address set by CMD_LOAD_ADDRESS increments through the following
+// reads and writes, so a page costs one round trip instead of the
+// 'U' and 't'/'d' pair of STK500v1.
+// Flash data is loaded into the target as it arrives. A message may cover
+// several pages, each page is committed when the next one begins and the
+// last one only after the checksum of the message was verified. The bytes
+// arriving during a commit wait in the serial ring of 64 bytes, so a
+// message of several pages needs a rate at which they fit, avrdude sends
+// a page at a time.
+
+#include "ArduinoISP.h"
+#include "STK500v2.h"
+
+#define V2_HEADER 9	// bytes of program command after the command id
+
+static uint8_t v2_seq;		// sequence number of the current message
+static uint16_t v2_size;	// body bytes remaining to receive
+static uint8_t v2_sum;		// checksum of the received or sent bytes
+
+// receive a byte of the message
+static uint8_t v2_getch() {
+	uint8_t c = ArduinoISP::getch();
+	v2_sum ^= c;
+	if (v2_size) v2_size--;
+	return c;
+}
+
+// receive the checksum and verify it, answer the error if mismatched
+static bool v2_checksum() {
+	while (v2_size) v2_getch();	// discard the body not taken
+	if (ArduinoISP::getch() == v2_sum) return true;
+	ArduinoISP::error++;
+	ArduinoISP::v2_answer(ANSWER_CKSUM_ERROR, STATUS_CKSUM_ERROR);
+	return false;
+}
+
+// discard the rest of a malformed message and answer STATUS_CMD_FAILED
+static void v2_reject(uint8_t cmd) {
+	if (!v2_checksum()) return;
+	ArduinoISP::error++;
+	ArduinoISP::v2_answer(cmd, STATUS_CMD_FAILED);
+}
+
+static void v2_put(uint8_t c) {
+	Serial.print((char) c);
+	v2_sum ^= c;
+}
+
+static void v2_begin(uint16_t size) {
+	v2_sum = 0;
+	v2_put(MESSAGE_START);
+	v2_put(v2_seq);
+	v2_put(size >> 8);
+	v2_put(size & 0xFF);
+	v2_put(TOKEN);
+}
+
+static void v2_end() {
+	Serial.print((char) v2_sum);
+}
+
+void ArduinoISP::v2_answer(uint8_t cmd, uint8_t status) {
+	v2_begin(2);
+	v2_put(cmd);
+	v2_put(status);
+	v2_end();
+}
+
+// answer of a command which returns one byte
+static void v2_answer_byte(uint8_t cmd, uint8_t b) {
+	v2_begin(4);
+	v2_put(cmd);
+	v2_put(STATUS_CMD_OK);
+	v2_put(b);
+	v2_put(STATUS_CMD_OK);
+	v2_end();
+}
+
+// wait for a write by the way the mode byte gives, (how) is the bits of
+// word mode or the page mode bits shifted down. the value polling reads
+// the location by (read) until it gives (data), it can not tell a value
+// equal to the poll values which the target reads while busy. RDY/BSY
+// polling is still bounded to the parts which have the instruction.
+static void v2_wait(uint8_t how, uint8_t ms, uint8_t read, uint16_t addr,
+	uint8_t data, uint8_t poll1, uint8_t poll2) {
+	if (how & MODE_WORD_RDY) {
+		ArduinoISP::wait_ready(ms);
+		return;
+	}
+	if (!(how & MODE_WORD_VALUE) || data == poll1 || data == poll2) {
+		delay(ms);
+		return;
+	}
+	unsigned long start = millis();
+	while (ArduinoISP::spi_transaction(read, (addr >> 8) & 0xFF, addr & 0xFF, 0x00) != data)
+		if (millis() - start > ms) break;
+}
+
+// commit the Flash page at (page) by cmd2 and wait for it. (data) at
+// (addr) read by (read) is the first byte which differs from poll1, it is
+// poll1 itself if there is none and then the wait is the delay.
+static void v2_commit(const uint8_t *hdr, int page, bool blank, uint8_t read,
+	int addr, uint8_t data) {
+	if (ArduinoISP::erased && blank) {
+		ArduinoISP::skipped_pages++;
+		return;
+	}
+	if (PROG_FLICKER) ArduinoISP::prog_lamp(LOW);
+	ArduinoISP::spi_transaction(hdr[5], (page >> 8) & 0xFF, page & 0xFF, 0x00);
+	v2_wait(hdr[2] >> 3, hdr[3], read, addr, data, hdr[7], hdr[7]);
+	if (PROG_FLICKER) ArduinoISP::prog_lamp(HIGH);
+}
+
+// CMD_PROGRAM_FLASH_ISP and CMD_PROGRAM_EEPROM_ISP
+// NumBytes (2), mode, delay, cmd1, cmd2, cmd3, poll1, poll2, data
+void ArduinoISP::v2_program(uint8_t cmd) {
+	uint8_t hdr[V2_HEADER];
+	if (v2_size < V2_HEADER) {
+		v2_reject(cmd);
+		return;
+	}
+	for (uint8_t i = 0; i < V2_HEADER; i++) hdr[i] = v2_getch();
+	uint16_t length = (hdr[0] << 8) | hdr[1];
+	uint8_t mode = hdr[2];
+	int start = here;
+	// the data must be in the message, or the next message is taken
+	if (length > v2_size) {
+		v2_reject(cmd);
+		return;
+	}
+	if (cmd == CMD_PROGRAM_FLASH_ISP && (mode & MODE_PAGE)) {
+		// load each byte as it arrives, see receive_ahead(). the page
+		// comes from the part table, the message does not tell it.
+		if (!part_page) {
+			v2_reject(cmd);
+			return;
+		}
+		int mask = ~(part_page - 1);
+		int page = here & mask;
+		bool blank = true;
+		uint8_t read = hdr[6];
+		int addr = page;
+		uint8_t poll = hdr[7];
+		uint16_t rx = 0;
+		for (uint16_t x = 0; x < length; x++) {
+			if (page != (here & mask)) {
+				v2_commit(hdr, page, blank, read, addr, poll);
+				page = here & mask;
+				blank = true;
+				poll = hdr[7];
+			}
+			rx = receive_ahead(rx, x, length, v2_getch);
+			uint8_t data = buff[x & 0xFF];
+			if (poll == hdr[7] && data != hdr[7]) {
+				read = hdr[6] | 8 * (x & 1);
+				addr = here;
+				poll = data;
+			}
+			blank &= data == 0xFF;
+			flash(x & 1, here, data);
+			if (x & 1) here++;
+		}
+		if (!v2_checksum()) return;
+		if (mode & MODE_WRITE_PAGE) v2_commit(hdr, page, blank, read, addr, poll);
+		v2_answer(cmd, STATUS_CMD_OK);
+		return;
+	}
+	if (cmd == CMD_PROGRAM_FLASH_ISP) {
+		// word mode writes each byte after the checksum was verified
+		for (uint16_t x = 0; x < length; x++) {
+			uint8_t data = v2_getch();
+			if (x < 256) buff[x] = data;
+		}
+		if (!v2_checksum()) return;
+		if (length > 256) {
+			error++;
+			v2_answer(cmd, STATUS_CMD_FAILED);
+			return;
+		}
+		for (uint16_t x = 0; x < length; x++) {
+			int addr = start + x / 2;
+			spi_transaction(hdr[4] + 8 * (x & 1), (addr >> 8) & 0xFF, addr & 0xFF, buff[x]);
+			v2_wait(mode, hdr[3], hdr[6] + 8 * (x & 1), addr, buff[x], hdr[7], hdr[7]);
+		}
+		here += length / 2;
+		v2_answer(cmd, STATUS_CMD_OK);
+		return;
+	}
+	// EEPROM is buffered and written after the checksum was verified
+	for (uint16_t x = 0; x < length; x++) {
+		uint8_t data = v2_getch();
+		if (x < 256) buff[x] = data;
+	}
+	if (!v2_checksum()) return;
+	if (length > 256) {
+		error++;
+		v2_answer(cmd, STATUS_CMD_FAILED);
+		return;
+	}
+	prog_lamp(LOW);
+	for (uint16_t x = 0; x < length; x++) {
+		int addr = start + x;
+		spi_transaction(hdr[4], (addr >> 8) & 0xFF, addr & 0xFF, buff[x]);
+		if (!(mode & MODE_PAGE))
+			v2_wait(mode, hdr[3], hdr[6], addr, buff[x], hdr[7], hdr[8]);
+	}
+	if ((mode & MODE_PAGE) && (mode & MODE_WRITE_PAGE) && length) {
+		int last = start + length - 1;
+		spi_transaction(hdr[5], (start >> 8) & 0xFF, start & 0xFF, 0x00);
+		v2_wait(mode >> 3, hdr[3], hdr[6], last, buff[length - 1], hdr[7], hdr[8]);
+	}
+	prog_lamp(HIGH);
+	here += length;
+	v2_answer(cmd, STATUS_CMD_OK);
+}
+
+// CMD_READ_FLASH_ISP and CMD_READ_EEPROM_ISP
+// NumBytes (2), cmd1. The data is sent while it is read.
+void ArduinoISP::v2_read(uint8_t cmd) {
+	if (v2_size < 3) {
+		v2_reject(cmd);
+		return;
+	}
+	uint16_t length = v2_getch() << 8;
+	length |= v2_getch();
+	v2_getch();
+	if (!v2_checksum()) return;
+	v2_begin(length + 3);
+	v2_put(cmd);
+	v2_put(STATUS_CMD_OK);
+	if (cmd == CMD_READ_FLASH_ISP) {
+		v2_sum ^= send_page('F', (uint32_t)here * 2, length);
+		here += length / 2;
+	}
+	else {
+		v2_sum ^= send_page('E', here, length);
+		here += length;
+	}
+	v2_put(STATUS_CMD_OK);
+	v2_end();
+}
+
+// CMD_SPI_MULTI
+// NumTx, NumRx, RxStartAddr, TxData. RxData is sent while it is clocked.
+// (n) is the body bytes received, TxData must be in it.
+static void v2_spi_multi(uint8_t cmd, uint8_t *body, uint16_t n) {
+	uint8_t num_tx = body[0];
+	uint8_t num_rx = body[1];
+	uint8_t rx_start = body[2];
+	if (n < 3 || 3 + num_tx > n) {
+		ArduinoISP::error++;
+		ArduinoISP::v2_answer(cmd, STATUS_CMD_FAILED);
+		return;
+	}
+	// the chip erase by the universal command as STK500v1 'V'
+	if (num_tx >= 2 && body[3] == 0xAC && body[4] == 0x80) ArduinoISP::erased = true;
+	v2_begin(num_rx + 3);
+	v2_put(cmd);
+	v2_put(STATUS_CMD_OK);
+	for (uint16_t i = 0; i < num_tx || i < rx_start + num_rx; i++) {
+		uint8_t rx = ArduinoISP::spi_send(i < num_tx ? body[3 + i] : 0x00);
+		if (i >= rx_start && i < rx_start + num_rx) v2_put(rx);
+	}
+	v2_put(STATUS_CMD_OK);
+	v2_end();
+}
+
+// read a fuse, lock, signature or calibration byte
+// RetAddr, cmd1, cmd2, cmd3, cmd4
+static uint8_t v2_read_byte(uint8_t *body) {
+	uint8_t rx[4];
+	for (uint8_t i = 0; i < 4; i++) rx[i] = ArduinoISP::spi_send(body[1 + i]);
+	return rx[(body[0] - 1) & 0x03];
+}
+
+// PARAM_SCK_DURATION as it was set, sck_duration holds it in the unit of
+// STK500v1 (8 / 7.3728MHz, about 1085ns). 0 to 3 are 1.8432MHz, 460.8kHz,
+// 115.2kHz and 57.6kHz, from 4 the period is (24 * d + 20) / 7.3728MHz.
+// the conversion rounds to the longer period.
+static uint8_t v2_sck;
+
+static uint8_t v2_sck_duration(uint8_t d) {
+	static const uint8_t fixed[] = { 1, 2, 8, 16 };
+	if (d < 4) return fixed[d];
+	return d <= 84 ? 3 * d + 3 : 255;
+}
+
+static uint8_t v2_get_parameter(uint8_t id) {
+	switch (id) {
+	case PARAM_HW_VER:
+		return HWVER;
+	case PARAM_SW_MAJOR:
+		return SWMAJ;
+	case PARAM_SW_MINOR:
+		return SWMIN;
+	case PARAM_VTARGET:
+		return VTARGET_5V;
+	case PARAM_SCK_DURATION:
+		return v2_sck;
+	default:
+		return 0;
+	}
+}
+
+// MESSAGE_START has already been received by avrisp()
+void ArduinoISP::stk500v2() {
+	v2_sum = MESSAGE_START;
+	v2_size = 0;
+	v2_seq = v2_getch();
+	uint16_t size = v2_getch() << 8;
+	size |= v2_getch();
+	if (v2_getch() != TOKEN || size == 0) {
+		// out of frame, wait for the next MESSAGE_START
+		error++;
+		return;
+	}
+	v2_size = size;
+	uint8_t cmd = v2_getch();
+	switch (cmd) {
+	case CMD_PROGRAM_FLASH_ISP:
+	case CMD_PROGRAM_EEPROM_ISP:
+		v2_program(cmd);
+		return;
+	case CMD_READ_FLASH_ISP:
+	case CMD_READ_EEPROM_ISP:
+		v2_read(cmd);
+		return;
+	}
+
+	// other messages are short, they are buffered until the checksum
+	uint16_t n = 0;
+	while (v2_size) {
+		uint8_t c = v2_getch();
+		if (n < 256) buff[n++] = c;
+	}
+	if (!v2_checksum()) return;
+	switch (cmd) {
+	case CMD_SIGN_ON:
+		error = 0;
+		v2_begin(3 + sizeof(SIGN_ON_STRING) - 1);
+		v2_put(cmd);
+		v2_put(STATUS_CMD_OK);
+		v2_put(sizeof(SIGN_ON_STRING) - 1);
+		for (const char *p = SIGN_ON_STRING; *p; p++) v2_put(*p);
+		v2_end();
+		break;
+	case CMD_SET_PARAMETER:
+		if (buff[0] == PARAM_SCK_DURATION) {
+			v2_sck = buff[1];
+			sck_duration = v2_sck_duration(v2_sck);
+		}
+		v2_answer(cmd, STATUS_CMD_OK);
+		break;
+	case CMD_GET_PARAMETER:
+		v2_begin(3);
+		v2_put(cmd);
+		v2_put(STATUS_CMD_OK);
+		v2_put(v2_get_parameter(buff[0]));
+		v2_end();
+		break;
+	case CMD_OSCCAL:
+		v2_answer(cmd, STATUS_CMD_OK);
+		break;
+	case CMD_LOAD_ADDRESS:
+		// the extended address (MSB) is not needed up to 128KB
+		here = (buff[2] << 8) | buff[3];
+		v2_answer(cmd, STATUS_CMD_OK);
+		break;
+	case CMD_ENTER_PROGMODE_ISP: {
+		uint32_t sig;
+		start_pmode();
+		v2_answer(cmd, spi_check(&sig) ? STATUS_CMD_OK : STATUS_CMD_FAILED);
+		break;
+	}
+	case CMD_LEAVE_PROGMODE_ISP:
+		error = 0;
+		end_pmode();
+		v2_answer(cmd, STATUS_CMD_OK);
+		break;
+	case CMD_CHIP_ERASE_ISP:
+		// eraseDelay, pollMethod, cmd1..4
+		spi_transaction(buff[2], buff[3], buff[4], buff[5]);
+		if (buff[1]) wait_ready(buff[0]);
+		else delay(buff[0]);
+		erased = true;
+		v2_answer(cmd, STATUS_CMD_OK);
+		break;
+	case CMD_PROGRAM_FUSE_ISP:
+	case CMD_PROGRAM_LOCK_ISP:
+		spi_transaction(buff[0], buff[1], buff[2], buff[3]);
+		v2_begin(3);
+		v2_put(cmd);
+		v2_put(STATUS_CMD_OK);
+		v2_put(STATUS_CMD_OK);
+		v2_end();
+		break;
+	case CMD_READ_FUSE_ISP:
+	case CMD_READ_LOCK_ISP:
+	case CMD_READ_SIGNATURE_ISP:
+	case CMD_READ_OSCCAL_ISP:
+		v2_answer_byte(cmd, v2_read_byte(buff));
+		break;
+	case CMD_SPI_MULTI:
+		v2_spi_multi(cmd, buff, n);
+		break;
+	default:
+		error++;
+		v2_answer(cmd, STATUS_CMD_UNKNOWN);
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef	__STK500V2_H_
+#define	__STK500V2_H_
+
+// STK500v2 protocol definitions for ArduinoISP
+// Taken from the command set of AVR068 (STK500 Communication Protocol)
+
+// Message framing
+#define MESSAGE_START             0x1B
+#define TOKEN                     0x0E
+
+// General commands
+#define CMD_SIGN_ON               0x01
+#define CMD_SET_PARAMETER         0x02
+#define CMD_GET_PARAMETER         0x03
+#define CMD_OSCCAL                0x05
+#define CMD_LOAD_ADDRESS          0x06
+#define CMD_FIRMWARE_UPGRADE      0x07
+
+// ISP commands
+#define CMD_ENTER_PROGMODE_ISP    0x10
+#define CMD_LEAVE_PROGMODE_ISP    0x11
+#define CMD_CHIP_ERASE_ISP        0x12
+#define CMD_PROGRAM_FLASH_ISP     0x13
+#define CMD_READ_FLASH_ISP        0x14
+#define CMD_PROGRAM_EEPROM_ISP    0x15
+#define CMD_READ_EEPROM_ISP       0x16
+#define CMD_PROGRAM_FUSE_ISP      0x17
+#define CMD_READ_FUSE_ISP         0x18
+#define CMD_PROGRAM_LOCK_ISP      0x19
+#define CMD_READ_LOCK_ISP         0x1A
+#define CMD_READ_SIGNATURE_ISP    0x1B
+#define CMD_READ_OSCCAL_ISP       0x1C
+#define CMD_SPI_MULTI             0x1D
+
+// Status constants
+#define STATUS_CMD_OK             0x00
+#define STATUS_CMD_FAILED         0xC0
+#define STATUS_CKSUM_ERROR        0xC1
+#define STATUS_CMD_UNKNOWN        0xC9
+#define ANSWER_CKSUM_ERROR        0xB0
+
+// Parameters
+#define PARAM_BUILD_NUMBER_LOW    0x80
+#define PARAM_BUILD_NUMBER_HIGH   0x81
+#define PARAM_HW_VER              0x90
+#define PARAM_SW_MAJOR            0x91
+#define PARAM_SW_MINOR            0x92
+#define PARAM_VTARGET             0x94
+#define PARAM_SCK_DURATION        0x98
+
+// Mode bits of CMD_PROGRAM_FLASH_ISP and CMD_PROGRAM_EEPROM_ISP
+// The wait of word mode is in bits 1-3, the same of page mode in bits 4-6
+#define MODE_PAGE                 0x01
+#define MODE_WORD_DELAY           0x02
+#define MODE_WORD_VALUE           0x04
+#define MODE_WORD_RDY             0x08
+#define MODE_WRITE_PAGE           0x80
+
+#define SIGN_ON_STRING            "AVRISP_2"
+#define VTARGET_5V                50
+
+#endif	/* __STK500V2_H_ */
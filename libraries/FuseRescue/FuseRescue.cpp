@@ -25,9 +25,10 @@
 // INCLUDE directive dependency
 #include "FuseRescue.h"
 #include <ctype.h>
-#include <stdio.h>
 #include <string.h>
 #include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include <MsTimer2.h>
 
 // Embedded version string for the Sketch
@@ -36,7 +37,30 @@
 // Retention of the current value for updating the fuse byte and byte lock
 // Device characteristic values
 uint8_t	FuseRescue::DEVICE_ID;							// Device identify signature
-static const device_sig_t	*DEVICE_TAG;			// Device identify tag
+static const device_rec_t	*DEVICE_TAG;			// Device identify tag
+// Memory geometry of the identified device
+static inline const device_mem_t *device_memory(void) {
+	return &DEVICE_MEMORY[pgm_read_byte(&DEVICE_TAG->memory)];
+}
+// Fuse byte of the identified device, the chip default or for the bootloader
+static uint8_t device_fuse(bool bootloader, uint8_t loc) {
+	uint8_t	rec = pgm_read_byte(bootloader ? &DEVICE_TAG->bt_fuse : &DEVICE_TAG->default_fuse);
+	return pgm_read_byte(&DEVICE_FUSES[rec][loc]);
+}
+// Cached state of the target, it saves the power cycle to read the Fuse
+// bytes again. verify_device() refreshes it, write_fuse() updates it by the
+// verified byte, chip erase drops the Lock bits and a different signature
+// drops all.
+static uint32_t	TARGET_SIG;
+static uint8_t	TARGET_FUSE[_LOCK_BITS + 1];	// Indexed by LOC_FUSE_BYTE
+static uint8_t	TARGET_VALID;					// Bit of LOC_FUSE_BYTE is set if cached
+// Timing profile in effect, it starts with the safe profile. The initializers
+// are folded from the constexpr table, they do not read the program space.
+#ifdef FUSERESCUE_TIMING
+static const pgm_timing_t	PGM_TIME = PGM_TIMING[FUSERESCUE_TIMING];
+#else
+static pgm_timing_t	PGM_TIME = PGM_TIMING[PGM_TIMING_SAFE];
+#endif
 
 // Operation commands definition
 #define OPCMD_WR_FUSE_LO	'L'				// Write low Fuse byte
@@ -47,26 +71,173 @@ static const device_sig_t	*DEVICE_TAG;			// Device identify tag
 #define OPCMD_WR_FUSE_AR	'A'				// Write Arduino bootloader Fuse byte
 #define OPCMD_ERASE			'E'				// Erase device
 #define OPCMD_VERIFY		'V'				// Verify device
+#define OPCMD_WR_FLASH		'F'				// Write Flash
+#define OPCMD_DUMP			'D'				// Dump Flash and EEPROM
+#define OPCMD_TRACE			'Y'				// Dump the pin trace
+#define OPCMD_ABORT			0x1b			// ESC aborts the running job
 static const char	CMD_LEXDEFINE[] __attribute__ ((aligned)) = {
 	OPCMD_WR_FUSE_LO, OPCMD_WR_FUSE_HI, OPCMD_WR_FUSE_EX,
 	OPCMD_WR_FUSE_KY, OPCMD_WR_FUSE_DE, OPCMD_WR_FUSE_AR,
-	OPCMD_ERASE, OPCMD_VERIFY, 0x00	
+	OPCMD_ERASE, OPCMD_VERIFY, OPCMD_DUMP,
+#ifdef PAGEL
+	OPCMD_WR_FLASH,
+#endif
+#ifdef PINTRACE
+	OPCMD_TRACE,
+#endif
+	0x00	
 };
 
 // Current executed command
 static uint8_t	CMD_CURRENT;
+// Command which is typed while a job is running, it is executed next
+static uint8_t	CMD_NEXT;
+
+// Binary protocol for the non-interactive operation
+// A request frame is STX, LEN, operations[LEN], SUM and the response
+// frame is STX, LEN, frame status, results[LEN - 1], SUM.
+// SUM makes 8 bits summation of LEN, payload and SUM zero.
+// Each operation is a command letter followed by a value byte for
+// L, H, X, K and S. Each result is the command letter, the result status and
+// the data which is three signature bytes for V, four Fuse and Lock bytes
+// for R, a verified byte for L, H, X and K, three verified bytes for W and A,
+// the rate index for S, and four busy times of BUSY_KIND order by 16 bits
+// microseconds in big endian for T. Operations are executed in order and stop at
+// the first failure. S switches the baud rate after the response frame.
+#define FRAME_STX			0x02			// Start of frame
+#define FRAME_MAX			64				// Maximum length of the payload
+#define FRAME_TIMEOUT		100				// Inter-byte time-out 100ms
+#define FRAME_RESULT_MAX	12				// Maximum length of a result
+// Request and response frame buffers which are claimed from the arena
+static uint8_t	*FRAME_REQ, *FRAME_RES;
+#ifdef PAGEL
+// Flash page buffer which is claimed from the arena
+static uint8_t	*PAGE_BUF;
+static_assert(2 * FRAME_MAX + MAX_PAGE_BYTES <= SRAM_ARENA_SIZE, "FuseRescue claims exceed SRAM_ARENA_SIZE");
+#else
+static_assert(2 * FRAME_MAX <= SRAM_ARENA_SIZE, "FuseRescue claims exceed SRAM_ARENA_SIZE");
+#endif
+#define OPCMD_READ			'R'				// Read back Fuse and Lock bytes, only in frame
+#define OPCMD_SPEED			'S'				// Switch the baud rate, only in frame
+#define OPCMD_TIMES			'T'				// Busy times of the last operations, only in frame
+static const uint32_t	BAUD_RATES[] PROGMEM = { FUSERESCUE_BAUD_RATES };
+// Frame status
+#define FRAME_ACK			0x00			// Frame accepted
+#define FRAME_NAK_TIMEOUT	0x01			// Frame is incomplete
+#define FRAME_NAK_SUM		0x02			// Checksum mismatch
+#define FRAME_NAK_LEN		0x03			// Frame too long
+// Result status
+#define FRAME_DONE			0x00			// Operation complete
+#define FRAME_FAIL_TIMEOUT	0x01			// RDY/#BSY time-out
+#define FRAME_FAIL_VERIFY	0x02			// Verify mismatch
+#define FRAME_FAIL_DEVICE	0x03			// Unknown device
+#define FRAME_FAIL_COMMAND	0x04			// Unknown operation or missing value
+#define FRAME_FAIL_OVERFLOW	0x05			// No room for the result
+// The terminal prompt is suppressed while the host talks with frames
+static bool	FRAME_MODE;
 // Command execution time out measure
 volatile bool	CMD_TIMEOUT;				// Time-out occurrence
 #define OPCMD_TRAP_TIMEOUT	200				// Time-out limit 200ms
 #define OPCMD_RETRY_MAX		3				// Write command retry maximum count
 
-// Create a FILE structure to reference for UART output function
-static FILE	UART_OUT = { 0 };
-// printf hooking up for Serial.write, although of type virtual,
-// already exists.
-static int	uart_putchar(char c, FILE *stream) {
-	Serial.write(c);
-	return 0;
+// RDY/#BSY busy period capture
+// Timer1 runs at clk/64 from the #WR pulse, the pin change interrupt of
+// RDY/#BSY stamps its rising edge. The period fits in 16 bits of Timer1
+// because it is shorter than OPCMD_TRAP_TIMEOUT.
+#define BUSY_TICK_US		4				// Timer1 resolution 4us
+static volatile bool		BUSY_READY;		// RDY/#BSY has risen
+static volatile uint16_t	BUSY_TICKS;		// Timer1 count at the rising edge
+uint16_t	FuseRescue::BUSY_TIME[_BUSY_KINDS];
+
+// Job of the asynchronous operation
+// The waits of the job are measured by the tick of MsTimer2, which also
+// wakes the CPU from the idle sleep while the job waits.
+#define JOB_TICK_MS			1				// Tick interval
+#define JOB_PROGRESS_MS		100				// Interval of the progress dot
+typedef enum {
+	STEP_POWER,								// Enter the programming mode
+	STEP_ISSUE,								// Load the command and pulse #WR
+	STEP_BUSY,								// Wait for RDY/#BSY
+	STEP_VERIFY,							// Read back the written byte
+	STEP_SETTLE,							// Wait for the written Fuse to settle
+	STEP_DISCHARGE,							// Wait for the target discharge before a retry
+	STEP_READ								// Read a byte
+} JOB_STEP;
+static struct {
+	FuseRescue::JOB_KIND	kind;
+	FuseRescue::JOB_STATE	state;
+	JOB_STEP		step;
+	LOC_FUSE_BYTE	loc;					// Fuse byte location to be written
+	uint8_t			value;					// Fuse byte to be written
+	uint8_t			index;					// Byte position of the reading
+	uint8_t			r_try;					// Retry count
+	bool			powered;				// The job holds a programming session
+	bool			abort;					// Abort is requested
+	uint16_t		begin;					// Tick at the job start
+	uint16_t		since;					// Tick at the step start
+	uint32_t		result;					// Signature or verified byte
+} JOB;
+static volatile uint16_t	JOB_TICKS;
+
+// Lightweight formatter for the terminal output.
+// Each field is converted by its own function and written straight into
+// the serial TX buffer, vfprintf and the stdout FILE are not linked.
+/**
+ * Put a string which is placed in the program space
+ * @param	str		PSTR string
+ */
+static void print_P(PGM_P str) {
+	char	c;
+
+	while ((c = pgm_read_byte(str++)))
+		Serial.write(c);
+}
+
+/**
+ * Put a value by the upper case hexadecimal digits with zero padding
+ * @param	value	A value to be put, 0x12 for a byte and 0x123456 for a signature
+ * @param	digits	Number of the digits
+ */
+static void print_hex(uint32_t value, uint8_t digits) {
+	while (digits--) {
+		uint8_t	nibble = (uint8_t)(value >> (digits << 2)) & 0x0f;
+		Serial.write(nibble < 10 ? '0' + nibble : 'A' - 10 + nibble);
+	}
+}
+
+/**
+ * Put a value by the decimal digits without padding
+ * @param	value	A value to be put
+ */
+static void print_dec(uint16_t value) {
+	char	digit[5];
+	uint8_t	n = 0;
+
+	do {
+		digit[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	while (n)
+		Serial.write(digit[--n]);
+}
+
+/**
+ * Put a line of the command list
+ * @param	command	Command letter
+ * @param	label	PSTR description of the command
+ */
+static void print_item(char command, PGM_P label) {
+	Serial.write(command);
+	Serial.write(':');
+	print_P(label);
+	print_P(PSTR("\r\n"));
+}
+
+/**
+ * Put the reason of the failed job
+ */
+static void print_failure(void) {
+	print_P(JOB.state == FuseRescue::JOB_ABORTED ? PSTR("Aborted, ") : PSTR("Time out, "));
 }
 
 /**
@@ -97,15 +268,18 @@ void FuseRescue::setup() {
 	// Control signals to the initial state
 	stable_signals();
 
+	// Claim the buffers of this mode from the arena shared with ArduinoISP
+	FRAME_REQ = (uint8_t *)SramArena::claim(FRAME_MAX);
+	FRAME_RES = (uint8_t *)SramArena::claim(FRAME_MAX);
+#ifdef PAGEL
+	PAGE_BUF = (uint8_t *)SramArena::claim(MAX_PAGE_BYTES);
+#endif
+
 	// Start the UART
-	Serial.begin(9600);
-	// Fill in the UART file descriptor with pointer to writer.
-	fdev_setup_stream(&UART_OUT, uart_putchar, NULL, _FDEV_SETUP_WRITE);
-	// The uart is the standard output device STDOUT.
-	stdout = &UART_OUT;
+	Serial.begin(FUSERESCUE_BAUDRATE);
 
 	// Start fuse operation via interactivity work
-	printf_P(PSTR("High-voltage Fuse Rescue for ATmega88 Ver."VERSION"\r\n"));
+	print_P(PSTR("High-voltage Fuse Rescue for ATmega88 Ver."VERSION"\r\n"));
 	// Show the verified device
 	CMD_CURRENT = OPCMD_VERIFY;
 	verify_device();
@@ -117,31 +291,59 @@ void FuseRescue::loop() {
 
 	if (CMD_CURRENT != 0x00) {
 		// Show command list
-		printf_P(PSTR("\r\n_________________________________________________\r\n"));
+		print_P(PSTR("\r\n_________________________________________________\r\n"));
 		if (DEVICE_ID != UNKNOWN_DEVICE) {
-			printf_P(PSTR("%c:Write low Fuse byte\r\n"), OPCMD_WR_FUSE_LO);
-			printf_P(PSTR("%c:Write high Fuse byte\r\n"), OPCMD_WR_FUSE_HI);
-			printf_P(PSTR("%c:Write extended Fuse byte\r\n"), OPCMD_WR_FUSE_EX);
-			printf_P(PSTR("%c:Write Lock bits\r\n"), OPCMD_WR_FUSE_KY);
-			printf_P(PSTR("%c:Write default Fuse bytes {0x%02X,0x%02X,0x%02X}\r\n"), OPCMD_WR_FUSE_DE,
-				pgm_read_byte(&DEVICE_TAG->default_fuse[0]),
-				pgm_read_byte(&DEVICE_TAG->default_fuse[1]),
-				pgm_read_byte(&DEVICE_TAG->default_fuse[2]));
-			printf_P(PSTR("%c:Write Fuse bytes for Arduino bootloader\r\n"), OPCMD_WR_FUSE_AR);
-			printf_P(PSTR("%c:Erase device\r\n"), OPCMD_ERASE);
+			print_item(OPCMD_WR_FUSE_LO, PSTR("Write low Fuse byte"));
+			print_item(OPCMD_WR_FUSE_HI, PSTR("Write high Fuse byte"));
+			print_item(OPCMD_WR_FUSE_EX, PSTR("Write extended Fuse byte"));
+			print_item(OPCMD_WR_FUSE_KY, PSTR("Write Lock bits"));
+			Serial.write(OPCMD_WR_FUSE_DE);
+			print_P(PSTR(":Write default Fuse bytes {"));
+			for (uint8_t i = 0; i < 3; i++) {
+				print_P(i ? PSTR(",0x") : PSTR("0x"));
+				print_hex(device_fuse(false, i), 2);
+			}
+			print_P(PSTR("}\r\n"));
+			print_item(OPCMD_WR_FUSE_AR, PSTR("Write Fuse bytes for Arduino bootloader"));
+			print_item(OPCMD_ERASE, PSTR("Erase device"));
+			print_item(OPCMD_DUMP, PSTR("Dump Flash and EEPROM (Intel HEX)"));
+#ifdef PAGEL
+			print_item(OPCMD_WR_FLASH, PSTR("Write Flash (Intel HEX)"));
+#endif
 		}
-		printf_P(PSTR("%c:Verify device\r\n"), OPCMD_VERIFY);
+		print_item(OPCMD_VERIFY, PSTR("Verify device"));
+#ifdef PINTRACE
+		print_item(OPCMD_TRACE, PSTR("Dump the pin trace (binary)"));
+#endif
 	}
 
-	// Scan the operation command from the serial port
-	while ((command = (uint8_t)inquiry("\r\nEnter command -->", CMD_LEXDEFINE, false)) == 0x00);
+	// Scan the operation command from the serial port, the command typed
+	// while the last job was running is taken first
+	if (CMD_NEXT) {
+		print_P(PSTR("\r\nEnter command -->"));
+		Serial.write(command = CMD_NEXT);
+		CMD_NEXT = 0x00;
+	} else
+		while ((command = (uint8_t)inquiry(FRAME_MODE ? "" : "\r\nEnter command -->", CMD_LEXDEFINE, false)) == 0x00);
+
+	// The binary protocol frame would be processed without the terminal interaction
+	if (command == FRAME_STX) {
+		Serial.read();
+		FRAME_MODE = true;
+		frame_command();
+		CMD_CURRENT = 0x00;
+		return;
+	}
+	FRAME_MODE = false;
 
 	// Parse the command and dispatch the writing process
 	CMD_CURRENT = command;
 	Serial.println();
 	if (DEVICE_ID == UNKNOWN_DEVICE)
-		if (command != OPCMD_VERIFY) {
-			printf_P(PSTR("'%c' command is not available now.\n\r"), command);
+		if (command != OPCMD_VERIFY && command != OPCMD_TRACE) {
+			Serial.write('\'');
+			Serial.write(command);
+			print_P(PSTR("' command is not available now.\n\r"));
 			CMD_CURRENT = 0x00;
 			return;
 		}
@@ -161,11 +363,26 @@ void FuseRescue::loop() {
 	case OPCMD_ERASE:
 		erase_device();
 		break;
+#ifdef PAGEL
+	case OPCMD_WR_FLASH:
+		write_flash();
+		break;
+#endif
 	case OPCMD_VERIFY:
 		verify_device();
 		break;
+	case OPCMD_DUMP:
+		dump_device();
+		break;
+#ifdef PINTRACE
+	case OPCMD_TRACE:
+		PinTrace::dump();
+		break;
+#endif
 	default:
-		printf_P(PSTR("'%c': Unknown\r\n"), command);
+		Serial.write('\'');
+		Serial.write(command);
+		print_P(PSTR("': Unknown\r\n"));
 		CMD_CURRENT = 0x00;
 		break;
 	}
@@ -187,6 +404,10 @@ char FuseRescue::inquiry(const char *query_string, const char *mask, bool moment
 	Serial.print(query_string);
 	do {
 		while (!Serial.available());
+		// A frame start of the binary protocol terminates the inquiry,
+		// it is left in the receive buffer for the dispatcher.
+		if (Serial.peek() == FRAME_STX)
+			return FRAME_STX;
 		c = Serial.read();
 		if (isalpha(c))
 			 c &= 0xdf;
@@ -196,7 +417,7 @@ char FuseRescue::inquiry(const char *query_string, const char *mask, bool moment
 				rc = 0x00;
 				c_count--;
 			}
-		} else if (strchr(mask, (int)c) > 0) {
+		} else if (strchr(mask, (int)c) != NULL) {
 			Serial.print(c);
 			c_count++;
 			rc = c;
@@ -219,15 +440,15 @@ char FuseRescue::inquiry(const char *query_string, const char *mask, bool moment
  */
 int16_t FuseRescue::inquiry_hex(const char *query_string) {
 	char	bin;
-	uint8_t	hex_value;
+	uint8_t	hex_value = 0;
 
 	bin = inquiry(query_string, "0123456789ABCEDF", true);
-	if (bin == 0x00)
+	if (bin == 0x00 || bin == FRAME_STX)
 		return -1;
 	hex_value += (bin >= '0' && bin <= '9') ? bin & 0x0f : bin - 0x37;
 
 	bin = inquiry("", "0123456789ABCEDF", false);
-	if (bin > 0x00) {
+	if (bin > 0x00 && bin != FRAME_STX) {
 		hex_value <<= 4;
 		hex_value += (bin >= '0' && bin <= '9') ? bin & 0x0f : bin - 0x37;
 	}
@@ -235,6 +456,189 @@ int16_t FuseRescue::inquiry_hex(const char *query_string) {
 	return (int16_t)hex_value;
 }
 
+/**
+ * Receive a byte of the frame with the inter-byte time-out.
+ * @return	A received byte, -1 if time-out occurred
+ */
+static int16_t frame_read(void) {
+	unsigned long	start = millis();
+
+	while (!Serial.available())
+		if (millis() - start > FRAME_TIMEOUT)
+			return -1;
+	return Serial.read();
+}
+
+/**
+ * Power up the target at the first operation of the frame which accesses it,
+ * the rest of the operations share the power-up.
+ * @param	powered	The frame holds a session
+ */
+static void frame_session(bool *powered) {
+	if (!*powered) {
+		FuseRescue::PgmSession::enter();
+		*powered = true;
+	}
+}
+
+/**
+ * Process a frame of the binary protocol, the STX has already been consumed.
+ * The operations in the frame are executed in order and the results are
+ * replied with one response frame.
+ */
+void FuseRescue::frame_command(void) {
+	uint8_t	*req = FRAME_REQ, *res = FRAME_RES;
+	uint8_t	res_len = 1, sum, i;
+	int16_t	c, len;
+	int16_t	speed = -1;
+	bool	powered = false;
+
+	// Receive the request frame
+	res[0] = FRAME_ACK;
+	if ((len = frame_read()) < 0)
+		res[0] = FRAME_NAK_TIMEOUT;
+	else if (len > FRAME_MAX) {
+		res[0] = FRAME_NAK_LEN;
+		while (frame_read() >= 0);			// Discard the rest of frame
+	}
+	else {
+		sum = (uint8_t)len;
+		for (i = 0; i < len; i++) {
+			if ((c = frame_read()) < 0)
+				break;
+			sum += (req[i] = (uint8_t)c);
+		}
+		if (i < len || (c = frame_read()) < 0)
+			res[0] = FRAME_NAK_TIMEOUT;
+		else if ((uint8_t)(sum + c))
+			res[0] = FRAME_NAK_SUM;
+	}
+
+	// Execute the operations, a rejected frame and the operations which do
+	// not access the target leave it unpowered
+	i = 0;
+	while (res[0] == FRAME_ACK && i < len) {
+		uint8_t	op = req[i++];
+		uint8_t	*status;
+
+		if (res_len + FRAME_RESULT_MAX > FRAME_MAX) {
+			res[res_len++] = op;
+			res[res_len++] = FRAME_FAIL_OVERFLOW;
+			break;
+		}
+		res[res_len++] = op;
+		status = &res[res_len++];
+		*status = FRAME_DONE;
+		if (DEVICE_ID == UNKNOWN_DEVICE && op != OPCMD_VERIFY && op != OPCMD_SPEED && op != OPCMD_TIMES) {
+			*status = FRAME_FAIL_DEVICE;
+			break;
+		}
+		switch (op) {
+		case OPCMD_VERIFY: {
+			frame_session(&powered);
+			uint32_t	sig = identify_device();
+			res[res_len++] = (uint8_t)(sig >> 16);
+			res[res_len++] = (uint8_t)(sig >> 8);
+			res[res_len++] = (uint8_t)sig;
+			if (DEVICE_ID == UNKNOWN_DEVICE)
+				*status = FRAME_FAIL_DEVICE;
+			break;
+		}
+		case OPCMD_READ:
+			frame_session(&powered);
+			res[res_len++] = read_fuse(_FUSE_BYTE_LOW);
+			res[res_len++] = read_fuse(_FUSE_BYTE_HIGH);
+			res[res_len++] = read_fuse(_FUSE_BYTE_EXT);
+			res[res_len++] = read_fuse(_LOCK_BITS);
+			break;
+		case OPCMD_WR_FUSE_LO:
+		case OPCMD_WR_FUSE_HI:
+		case OPCMD_WR_FUSE_EX:
+		case OPCMD_WR_FUSE_KY: {
+			LOC_FUSE_BYTE	fb = op == OPCMD_WR_FUSE_LO ? _FUSE_BYTE_LOW :
+								(op == OPCMD_WR_FUSE_HI ? _FUSE_BYTE_HIGH :
+								(op == OPCMD_WR_FUSE_EX ? _FUSE_BYTE_EXT : _LOCK_BITS));
+			uint8_t	fuse, wb_fuse;
+			if (i >= len) {
+				*status = FRAME_FAIL_COMMAND;
+				break;
+			}
+			fuse = req[i++];
+			frame_session(&powered);
+			res[res_len++] = wb_fuse = write_fuse(fb, fuse);
+			if (CMD_TIMEOUT)
+				*status = FRAME_FAIL_TIMEOUT;
+			else if (wb_fuse != fuse)
+				*status = FRAME_FAIL_VERIFY;
+			break;
+		}
+		case OPCMD_WR_FUSE_DE:
+		case OPCMD_WR_FUSE_AR: {
+			LOC_FUSE_BYTE	fb[] = { _FUSE_BYTE_LOW, _FUSE_BYTE_HIGH, _FUSE_BYTE_EXT };
+			frame_session(&powered);
+			for (uint8_t f = 0; f < sizeof fb / sizeof(LOC_FUSE_BYTE); f++) {
+				uint8_t	fuse = device_fuse(op == OPCMD_WR_FUSE_AR, f);
+				uint8_t	wb_fuse = 0xff;
+				// Remaining bytes are not written after a failure
+				if (*status == FRAME_DONE) {
+					wb_fuse = write_fuse(fb[f], fuse);
+					if (CMD_TIMEOUT)
+						*status = FRAME_FAIL_TIMEOUT;
+					else if (wb_fuse != fuse)
+						*status = FRAME_FAIL_VERIFY;
+				}
+				res[res_len++] = wb_fuse;
+			}
+			break;
+		}
+		case OPCMD_ERASE:
+			frame_session(&powered);
+			erase_chip();
+			if (CMD_TIMEOUT)
+				*status = FRAME_FAIL_TIMEOUT;
+			break;
+		case OPCMD_SPEED:
+			if (i >= len || req[i] >= sizeof BAUD_RATES / sizeof(uint32_t)) {
+				*status = FRAME_FAIL_COMMAND;
+				break;
+			}
+			res[res_len++] = speed = req[i++];
+			break;
+		case OPCMD_TIMES:
+			for (uint8_t k = 0; k < _BUSY_KINDS; k++) {
+				res[res_len++] = (uint8_t)(BUSY_TIME[k] >> 8);
+				res[res_len++] = (uint8_t)BUSY_TIME[k];
+			}
+			// SRAM high-water mark follows the busy times
+			res[res_len++] = (uint8_t)(SramArena::high_water() >> 8);
+			res[res_len++] = (uint8_t)SramArena::high_water();
+			break;
+		default:
+			*status = FRAME_FAIL_COMMAND;
+			break;
+		}
+		if (*status != FRAME_DONE)
+			break;
+	}
+	if (powered)
+		PgmSession::leave();
+
+	// Reply the response frame
+	sum = res_len;
+	Serial.write(FRAME_STX);
+	Serial.write(res_len);
+	for (i = 0; i < res_len; i++) {
+		Serial.write(res[i]);
+		sum += res[i];
+	}
+	Serial.write((uint8_t)-sum);
+	// The new baud rate takes effect after the response has gone
+	if (speed >= 0) {
+		Serial.flush();
+		Serial.begin(pgm_read_dword(&BAUD_RATES[speed]));
+	}
+}
+
 /**
  * Write Fuse byte one by one as the extended byte, the low byte and the high byte.
  * @param	command		enumeration value
@@ -243,43 +647,58 @@ void FuseRescue::write_fuse_each(uint8_t command) {
 	LOC_FUSE_BYTE	fb;
 	uint8_t			fuse;
 	int16_t			new_fuse;
-	const char		*loc_fuse;
+	PGM_P			loc_fuse;
 
 	// Verify the current fuse byte and inquiry the write execution
 	switch (command) {
 	case OPCMD_WR_FUSE_LO:
 		fb = _FUSE_BYTE_LOW;
-		loc_fuse = "low";
+		loc_fuse = PSTR("low");
 		break;
 	case OPCMD_WR_FUSE_HI:
 		fb = _FUSE_BYTE_HIGH;
-		loc_fuse = "high";
+		loc_fuse = PSTR("high");
 		break;
 	case OPCMD_WR_FUSE_EX:
 		fb = _FUSE_BYTE_EXT;
-		loc_fuse = "ext";
+		loc_fuse = PSTR("ext");
 		break;
 	}
-	// Read current Fuse byte which is specified and echo to display.
-	fuse = read_fuse(fb);
-	printf_P(PSTR("Current Fuse(%s) 0x%02X "), loc_fuse, fuse);
+	// Current Fuse byte which is specified and echo to display.
+	fuse = cached_fuse(fb);
+	print_P(PSTR("Current Fuse("));
+	print_P(loc_fuse);
+	print_P(PSTR(") 0x"));
+	print_hex(fuse, 2);
+	Serial.write(' ');
 	// Inquiry the new Fuse value and execute writing
 	if ((new_fuse = inquiry_hex(", Enter new value (HEX, NULL leave w/o change) --> ")) >= 0) {
 		// New Fuse byte is specified, inquiry the writing
 		fuse = (uint8_t)new_fuse;
-		printf_P(PSTR("    New Fuse(%s) 0x%02X"), loc_fuse, fuse);
+		print_P(PSTR("    New Fuse("));
+		print_P(loc_fuse);
+		print_P(PSTR(") 0x"));
+		print_hex(fuse, 2);
 		if ((inquiry(".  Write ? (Y/N) ", "YN", false) & 0xdf) == 'Y') {
 			// Execute write
-			printf_P(PSTR("  Writing... "));
+			print_P(PSTR("  Writing... "));
+			PgmSession	session;
+			if (target_changed())
+				return;
 			uint8_t wb_fuse = write_fuse(fb, fuse);
 			// If time-out with retry count excess occurs CMD_TIMEOUT will be indicated it.
 			// If verify error occurs, value of the r_try will exceed limit.
-			if (CMD_TIMEOUT)
-				printf_P(PSTR("Time out, Fuse can not be written."));
-			else if (wb_fuse != fuse)
-				printf_P(PSTR("Verify 0x%0X"), wb_fuse);
-			else
-				printf_P(PSTR("complete."));
+			if (CMD_TIMEOUT) {
+				print_failure();
+				print_P(PSTR("Fuse can not be written."));
+			} else if (wb_fuse != fuse) {
+				print_P(PSTR("Verify 0x"));
+				print_hex(wb_fuse, 2);
+			} else {
+				print_P(PSTR("complete. ("));
+				print_dec(BUSY_TIME[BUSY_FUSE]);
+				print_P(PSTR("us)"));
+			}
 		}
 	}
 }
@@ -289,37 +708,48 @@ void FuseRescue::write_fuse_each(uint8_t command) {
  */
 void FuseRescue::write_fuse_default(void) {
 	LOC_FUSE_BYTE	fb[] = { _FUSE_BYTE_LOW, _FUSE_BYTE_HIGH, _FUSE_BYTE_EXT };
-	const char	*fb_loc[] = { "low", "high", "ext" };
+	PGM_P	fb_loc[] = { PSTR("low"), PSTR("high"), PSTR("ext") };
 
 	if ((inquiry("Write default Fuse bytes ? (Y/N) ", "YN", false) & 0xdf) == 'Y') {
 		uint8_t fuse, wb_fuse;
-		// Inquiry Fuse writing, apply default Fuse bytes
-		printf_P(PSTR("  Writing... "));
+		// Inquiry Fuse writing, apply default Fuse bytes in one power-up
+		PgmSession	session;
+		print_P(PSTR("  Writing... "));
+		if (target_changed())
+			return;
 		for (uint8_t i = 0; i < sizeof fb / sizeof(LOC_FUSE_BYTE); i++) {
 			// Retrieve default Fuse byte
 			switch (CMD_CURRENT) {
 			case  OPCMD_WR_FUSE_DE:
-				fuse = pgm_read_byte(&DEVICE_TAG->default_fuse[i]);
+				fuse = device_fuse(false, i);
 				break;
 			case  OPCMD_WR_FUSE_AR:
-				fuse = pgm_read_byte(&DEVICE_TAG->bt_fuse[i]);
+				fuse = device_fuse(true, i);
 				break;
 			}
-			printf_P(PSTR("%s:0x%02X "), fb_loc[i], fuse);
+			print_P(fb_loc[i]);
+			print_P(PSTR(":0x"));
+			print_hex(fuse, 2);
+			Serial.write(' ');
 			// Execute write
 			uint8_t wb_fuse = write_fuse(fb[i], fuse);
 			// If time-out with retry count excess occurs CMD_TIMEOUT will be indicated it.
 			// If verify error occurs, value of the r_try will exceed limit.
 			if (CMD_TIMEOUT) {
-				printf_P(PSTR("Time out, Fuse can not be written."));
+				print_failure();
+				print_P(PSTR("Fuse can not be written."));
 				break;
 			} else if (wb_fuse != fuse) {
-				printf_P(PSTR("Verify 0x%0X"), wb_fuse);
+				print_P(PSTR("Verify 0x"));
+				print_hex(wb_fuse, 2);
 				break;
 			}
 		}
-		if (!CMD_TIMEOUT & (wb_fuse == fuse))
-			printf_P(PSTR(" complete."));
+		if (!CMD_TIMEOUT & (wb_fuse == fuse)) {
+			print_P(PSTR(" complete. ("));
+			print_dec(BUSY_TIME[BUSY_FUSE]);
+			print_P(PSTR("us)"));
+		}
 	}
 }
 
@@ -335,42 +765,41 @@ void FuseRescue::write_fuse_default(void) {
  * @return	Verified Fuse data after writing finish
  */
 uint8_t	FuseRescue::write_fuse(LOC_FUSE_BYTE loc, uint8_t fuse) {
-	uint8_t		wb_fuse, r_try = 0;
+	// The writing and the verify reading run as a job
+	job_start(JOB_WRITE, loc, fuse);
+	job_wait();
+	return (uint8_t)job_result();
+}
 
-	do {
-		// Start the parallel programming sequence
-		// that is attempted up to OPCMD_RETRY_MAX.
-		delay(9);
-		start_pgm();
-		load_command(CMD_WRITEFUSE);		// load write fuse command
-		load_data(fuse);					// Enables data loading
-		// Specify Fuse byte location
-		switch (loc) {
-		case _FUSE_BYTE_LOW:				// Low byte of the fuse
-			// The previous signal is available and the signal change does not necessary.
-			//digitalWrite(BS1, LOW);
-			//digitalWrite(BS2, LOW);
-			break;
-		case _FUSE_BYTE_HIGH:				// High byte of the fuse
-			digitalWrite(BS1, HIGH);
-			//digitalWrite(BS2, LOW);
-			break;
-		case _FUSE_BYTE_EXT:				// Extended byte of the fuse
-			//digitalWrite(BS1, LOW);			// Stabilized
-			digitalWrite(BS2, HIGH);
-			break;
-		}
-		// Execute fuse writing
-		persist_data();
-		// Terminate the Fuse Writing
-		digitalWrite(BS1, LOW);
-		digitalWrite(BS2, LOW);
-		end_pgm();
-	} while (!CMD_TIMEOUT &&
-			(((wb_fuse = read_fuse(loc)) != fuse) & (++r_try <= OPCMD_RETRY_MAX)));
+/**
+ * Fuse byte from the cached target state, the byte is read from the target
+ * only if it is not cached.
+ * @param	loc		Enumeration value of Fuse byte address
+ * @return	Fuse byte
+ */
+uint8_t FuseRescue::cached_fuse(LOC_FUSE_BYTE loc) {
+	if (!(TARGET_VALID & _BV(loc))) {
+		TARGET_FUSE[loc] = read_fuse(loc);
+		TARGET_VALID |= _BV(loc);
+	}
+	return TARGET_FUSE[loc];
+}
+
+/**
+ * Detect the replacement of the target by the signature before writing.
+ * It should be called in the session of the writing, the signature is read
+ * without the extra power cycle. If the target is replaced, the device is
+ * identified again and the cached state is dropped.
+ * @return	true if the target has been replaced
+ */
+bool FuseRescue::target_changed(void) {
+	uint32_t	sig = TARGET_SIG;
 
-	delay(100);
-	return wb_fuse;
+	identify_device();
+	if (TARGET_SIG == sig && DEVICE_ID != UNKNOWN_DEVICE)
+		return false;
+	print_P(PSTR("Target has been changed, verify it again."));
+	return true;
 }
 
 /**
@@ -380,28 +809,38 @@ void FuseRescue::write_lock_bits(void) {
 	uint8_t	lock_bits;
 	int16_t	new_lock;
 
-	lock_bits = read_fuse(_LOCK_BITS);
-	printf_P(PSTR("Current Lock bits 0x%02X"), lock_bits);
+	lock_bits = cached_fuse(_LOCK_BITS);
+	print_P(PSTR("Current Lock bits 0x"));
+	print_hex(lock_bits, 2);
 	if ((new_lock = inquiry_hex(", Enter new value (HEX, NULL leave w/o change) --> ")) >= 0) {
 		// New Lock byte is specified correctly, inquiry the writing
 		lock_bits = (uint8_t)new_lock;
-		printf_P(PSTR("    New Lock bits:0x%02X"), lock_bits);
+		print_P(PSTR("    New Lock bits:0x"));
+		print_hex(lock_bits, 2);
 		// Caution, if the combination of Lock bits apply with LB3, Fuse bytes
 		// would be protected and it can not be changed in parallel programming.
 		if (!(lock_bits & 0x03))
-			printf_P(PSTR("(LB mode 3, Lock bits and Fuse bytes will be locked!)"));
+			print_P(PSTR("(LB mode 3, Lock bits and Fuse bytes will be locked!)"));
 		// Execute Lock bits writing after the inquiry
 		if ((inquiry(".  Write ? (Y/N) ", "YN", false) & 0xdf) == 'Y') {
-			printf_P(PSTR("  Writing... "));
+			print_P(PSTR("  Writing... "));
+			PgmSession	session;
+			if (target_changed())
+				return;
 			// Execute write
 			uint8_t wb_lb = write_fuse(_LOCK_BITS, lock_bits);
 			// If time-out with retry count excess occurs CMD_TIMEOUT will be indicated it.
-			if (CMD_TIMEOUT)
-				printf_P(PSTR("Time out, Lock bits can not be written."));
-			else if (wb_lb != lock_bits)
-				printf_P(PSTR("Verify 0x%02X"), wb_lb);
-			else
-				printf_P(PSTR("complete."));
+			if (CMD_TIMEOUT) {
+				print_failure();
+				print_P(PSTR("Lock bits can not be written."));
+			} else if (wb_lb != lock_bits) {
+				print_P(PSTR("Verify 0x"));
+				print_hex(wb_lb, 2);
+			} else {
+				print_P(PSTR("complete. ("));
+				print_dec(BUSY_TIME[BUSY_LOCK]);
+				print_P(PSTR("us)"));
+			}
 		}
 	}
 }
@@ -416,9 +855,9 @@ void FuseRescue::write_lock_bits(void) {
  */
 uint8_t FuseRescue::read_fuse(LOC_FUSE_BYTE loc) {
 	uint8_t	fuse;
-	
 	// Start parallel programming with fuse read
-	start_pgm();
+	PgmSession	session;
+
 	load_command(CMD_READFUSE);
 	// Read each the fuse byte individually via loc parameter
 	switch (loc) {
@@ -443,8 +882,9 @@ uint8_t FuseRescue::read_fuse(LOC_FUSE_BYTE loc) {
 	}
 	// Stroke the output enable, read fuse byte
 	fuse = retrieve_data();
-	// Stop programming
-	end_pgm();
+	// Restore the byte select for the following operation in the session
+	digitalWrite(BS1, LOW);
+	digitalWrite(BS2, LOW);
 
 	return fuse;
 }
@@ -454,23 +894,224 @@ uint8_t FuseRescue::read_fuse(LOC_FUSE_BYTE loc) {
  */
 void FuseRescue::erase_device(void) {
 	if ((inquiry("Flash and EEPROM, Lock bits will be cleared. Erase ? (Y/N) ", "YN", false) & 0xdf) == 'Y') {
-		printf_P(PSTR("Erasing... "));
-		uint8_t	r_try = 0;
-		do {
-			// Start the parallel programming sequence
-			// that is attempted up to OPCMD_RETRY_MAX.
-			delay(9);
-			start_pgm();
-			load_command(CMD_CHIPERASE);		// Load erase command
-			// Execute chip erase
-			persist_data();
-			end_pgm();							// End parallel programming
-		} while (CMD_TIMEOUT && ++r_try < OPCMD_RETRY_MAX);
+		print_P(PSTR("Erasing... "));
+		PgmSession	session;
+		if (target_changed())
+			return;
+		erase_chip();
 		// If time-out with retry count excess occurs CMD_TIMEOUT will be indicated it.
-		printf_P(CMD_TIMEOUT ? PSTR("Time out, chip can not be erased.") : PSTR("complete."));
+		if (CMD_TIMEOUT) {
+			print_failure();
+			print_P(PSTR("chip can not be erased."));
+		} else {
+			print_P(PSTR("complete. ("));
+			print_dec(BUSY_TIME[BUSY_ERASE]);
+			print_P(PSTR("us)"));
+		}
 	}
 }
 
+/**
+ * Execute the chip erase that is attempted up to OPCMD_RETRY_MAX.
+ * If time-out with retry count excess occurs CMD_TIMEOUT will be indicated it.
+ */
+void FuseRescue::erase_chip(void) {
+	job_start(JOB_ERASE);
+	job_wait();
+}
+
+#ifdef PAGEL
+/**
+ * Receive a byte of the Intel HEX record as two hexadecimal characters.
+ * @param	sum		Checksum of the record, the received byte is added
+ * @return	A received byte, -1 if non hexadecimal character is received
+ */
+static int16_t receive_hex(uint8_t *sum) {
+	char	c;
+	uint8_t	value = 0;
+
+	for (uint8_t i = 0; i < 2; i++) {
+		while (!Serial.available());
+		c = Serial.read();
+		if (isalpha(c))
+			c &= 0xdf;
+		if (c >= '0' && c <= '9')
+			value = (value << 4) + (c & 0x0f);
+		else if (c >= 'A' && c <= 'F')
+			value = (value << 4) + c - 0x37;
+		else
+			return -1;
+	}
+	*sum += value;
+	return (int16_t)value;
+}
+
+/**
+ * Write the Flash with Intel HEX records which are sent from the terminal.
+ * The chip is erased at first, then the records are stored into the page
+ * buffer and each page is programmed as soon as the address leaves it.
+ * The whole sequence runs in one parallel programming session.
+ */
+void FuseRescue::write_flash(void) {
+	uint8_t		*page_buf = PAGE_BUF;
+	uint16_t	page_bytes = pgm_read_byte(&device_memory()->page_size) * 2;
+	uint32_t	flash_bytes = (uint32_t)pgm_read_word(&device_memory()->flash_size) * 2;
+	int16_t		page = -1;
+	uint16_t	pages = 0;
+	bool		eof = false, fail = false;
+
+	if ((inquiry("Flash and EEPROM, Lock bits will be cleared. Write Flash ? (Y/N) ", "YN", false) & 0xdf) != 'Y')
+		return;
+	print_P(PSTR("Send Intel HEX... "));
+	PgmSession	session;
+	load_command(CMD_CHIPERASE);			// Flash must be erased before the page programming
+	BUSY_TIME[BUSY_ERASE] = persist_data();
+	TARGET_VALID &= ~_BV(_LOCK_BITS);		// Chip erase clears the Lock bits
+	if (!CMD_TIMEOUT)
+		load_command(CMD_WRITEFLASH);		// Load write Flash command
+	while (!CMD_TIMEOUT && !eof && !fail) {
+		uint8_t		sum = 0;
+		int16_t		count, addr_h, addr_l, type, data;
+		uint16_t	addr;
+
+		// Synchronize to the start code of the record
+		while (!Serial.available());
+		if (Serial.read() != ':')
+			continue;
+		if ((count = receive_hex(&sum)) < 0 || (addr_h = receive_hex(&sum)) < 0 ||
+			(addr_l = receive_hex(&sum)) < 0 || (type = receive_hex(&sum)) < 0) {
+			fail = true;
+			break;
+		}
+		addr = ((uint16_t)addr_h << 8) + addr_l;
+		while (count--) {
+			if ((data = receive_hex(&sum)) < 0 || (type == 0x00 && addr >= flash_bytes)) {
+				fail = true;
+				break;
+			}
+			if (type == 0x00) {
+				// Program the previous page when the address leaves it
+				if ((int16_t)(addr / page_bytes) != page) {
+					if (page >= 0) {
+						program_page(page * (page_bytes / 2), page_buf);
+						pages++;
+					}
+					memset(page_buf, 0xff, page_bytes);
+					page = addr / page_bytes;
+				}
+				page_buf[addr++ % page_bytes] = (uint8_t)data;
+			}
+		}
+		// Verify the checksum of the record
+		if (fail || receive_hex(&sum) < 0 || sum != 0)
+			fail = true;
+		else if (type == 0x01)
+			eof = true;
+	}
+	// Program the remaining page
+	if (!fail && !CMD_TIMEOUT && page >= 0) {
+		program_page(page * (page_bytes / 2), page_buf);
+		pages++;
+	}
+	load_command(CMD_NOOP);					// End page programming
+	if (CMD_TIMEOUT)
+		print_P(PSTR("Time out, Flash can not be written."));
+	else {
+		if (fail)
+			print_P(PSTR("Invalid record, "));
+		print_dec(pages);
+		print_P(fail ? PSTR(" pages written.") : PSTR(" pages complete."));
+	}
+}
+
+/**
+ * Program a Flash page with the page loading.
+ * The write Flash command must be loaded in advance.
+ * @param	word_addr	Word address of the page top
+ * @param	data		Page data, low byte precedes in each word
+ */
+void FuseRescue::program_page(uint16_t word_addr, const uint8_t *data) {
+	uint8_t	page_words = pgm_read_byte(&device_memory()->page_size);
+
+	// Fill the page buffer
+	for (uint8_t w = 0; w < page_words; w++) {
+		load_address_low((uint8_t)(word_addr + w));
+		load_data(*data++);
+		load_data_high(*data++);
+		latch_data();
+	}
+	// Program the page with the high address byte
+	load_address_high((uint8_t)(word_addr >> 8));
+	BUSY_TIME[BUSY_FLASH] = persist_data();
+}
+#endif
+
+/**
+ * Dump the whole Flash and EEPROM as Intel HEX in one parallel programming session.
+ * Each record is sent as soon as it is read, so the image is not held in SRAM.
+ * The Flash records precede the EEPROM records, each terminated by the EOF record.
+ */
+void FuseRescue::dump_device(void) {
+	uint8_t		rec[16];
+	uint32_t	flash_bytes = (uint32_t)pgm_read_word(&device_memory()->flash_size) * 2;
+	uint16_t	eeprom_bytes = pgm_read_word(&device_memory()->eeprom_size);
+
+	if ((inquiry("Dump Flash and EEPROM ? (Y/N) ", "YN", false) & 0xdf) != 'Y')
+		return;
+	PgmSession	session;
+	// Read Flash, each word is read by the low byte and the high byte
+	print_P(PSTR("Flash:\r\n"));
+	load_command(CMD_READFLASH);
+	for (uint32_t addr = 0; addr < flash_bytes; addr += sizeof rec) {
+		for (uint8_t i = 0; i < sizeof rec; i += 2) {
+			uint16_t	word = (uint16_t)((addr + i) >> 1);
+			if (!(word & 0xff))
+				load_address_high((uint8_t)(word >> 8));
+			load_address_low((uint8_t)word);
+			rec[i] = retrieve_data();
+			digitalWrite(BS1, HIGH);
+			rec[i + 1] = retrieve_data();
+		}
+		send_hex_record((uint16_t)addr, 0x00, rec, sizeof rec);
+	}
+	send_hex_record(0x0000, 0x01, rec, 0);
+	// Read EEPROM
+	print_P(PSTR("EEPROM:\r\n"));
+	load_command(CMD_READEEPROM);
+	for (uint16_t addr = 0; addr < eeprom_bytes; addr += sizeof rec) {
+		for (uint8_t i = 0; i < sizeof rec; i++) {
+			if (!((addr + i) & 0xff))
+				load_address_high((uint8_t)((addr + i) >> 8));
+			load_address_low((uint8_t)(addr + i));
+			rec[i] = retrieve_data();
+		}
+		send_hex_record(addr, 0x00, rec, sizeof rec);
+	}
+	send_hex_record(0x0000, 0x01, rec, 0);
+}
+
+/**
+ * Send a record of Intel HEX format.
+ * @param	addr	Load offset of the record
+ * @param	type	Record type
+ * @param	data	Data bytes of the record
+ * @param	count	Number of the data bytes
+ */
+void FuseRescue::send_hex_record(uint16_t addr, uint8_t type, const uint8_t *data, uint8_t count) {
+	uint8_t	sum = count + (uint8_t)(addr >> 8) + (uint8_t)addr + type;
+
+	Serial.write(':');
+	print_hex(count, 2);
+	print_hex(addr, 4);
+	print_hex(type, 2);
+	while (count--) {
+		print_hex(*data, 2);
+		sum += *data++;
+	}
+	print_hex((uint8_t)-sum, 2);
+	print_P(PSTR("\r\n"));
+}
+
 /**
  * Read signature byte from the target chip and echo the device name identified
  * by the read signature. Global variable DEVICE_TAG will have index of device
@@ -480,37 +1121,77 @@ void FuseRescue::erase_device(void) {
 void FuseRescue::verify_device(void) {
 	uint32_t	detect_sig;
 	uint8_t		vf_fuse_low, vf_fuse_high, vf_fuse_ext, vf_lock;
+	// The signature and all the Fuse bytes are read in one power-up
+	PgmSession	session;
 
 	// Show the verified device
+	print_P(PSTR("  Verify the target... "));
+	detect_sig = identify_device();
+	// DEVICE_ID still unknown, not supported device detected
+	if (DEVICE_ID == UNKNOWN_DEVICE) {
+		print_P(PSTR("Signature:0x"));
+		print_hex(detect_sig, 6);
+		print_P(PSTR("  UNKNOWN DEVICE\r\n"));
+	} else {
+		// Detects the correct device
+		// Echo device type from device characteristics table
+		print_P(&DEVICE_PREFIXES[pgm_read_byte(&DEVICE_TAG->prefix)]);
+		print_P(&DEVICE_NAMES[pgm_read_word(&DEVICE_TAG->name)]);
+		// Inquiry current fuse byte and lock byte, it refreshes the cached state
+		job_start(JOB_FUSES);
+		job_wait();
+		vf_fuse_low = TARGET_FUSE[_FUSE_BYTE_LOW];
+		vf_fuse_high = TARGET_FUSE[_FUSE_BYTE_HIGH];
+		vf_fuse_ext = TARGET_FUSE[_FUSE_BYTE_EXT];
+		vf_lock = TARGET_FUSE[_LOCK_BITS];
+		// Responds current byte value
+		print_P(PSTR("(0x"));
+		print_hex(detect_sig, 6);
+		print_P(PSTR(")\n\r  Fuse:0x"));
+		print_hex(vf_fuse_low, 2);
+		print_P(PSTR("(low),0x"));
+		print_hex(vf_fuse_high, 2);
+		print_P(PSTR("(high),0x"));
+		print_hex(vf_fuse_ext, 2);
+		print_P(PSTR("(ext)  Lock:0x"));
+		print_hex(vf_lock, 2);
+		print_P(PSTR("\n\r"));
+	}
+}
+
+/**
+ * Identify the device by the signature in the device characteristics table.
+ * DEVICE_ID and DEVICE_TAG are updated, DEVICE_ID would be UNKNOWN_DEVICE
+ * if the signature is not supported.
+ * @return	A read signature by long integer
+ */
+uint32_t FuseRescue::identify_device(void) {
+	uint32_t	detect_sig;
+
+	// The signature is read with the safe timing until the device is known
 	DEVICE_ID = UNKNOWN_DEVICE;
-	printf_P(PSTR("  Verify the target... "));
+#ifndef FUSERESCUE_TIMING
+	memcpy_P(&PGM_TIME, &PGM_TIMING[PGM_TIMING_SAFE], sizeof PGM_TIME);
+#endif
 	detect_sig = read_signature();
-	for (uint8_t detect_id = 0; detect_id < sizeof DEVICE_LIST / sizeof(device_sig_t); detect_id++) {
+	// Another chip is in the socket, the cached state belongs to the former one
+	if (detect_sig != TARGET_SIG) {
+		TARGET_SIG = detect_sig;
+		TARGET_VALID = 0;
+	}
+	// The perfect hash points the only entry which can have the signature
+	if ((uint8_t)(detect_sig >> 16) == DEVICE_VENDOR) {
+		uint8_t	disp = pgm_read_byte(&DEVICE_DISP[device_hash(detect_sig, 0) % DEVICE_BUCKETS]);
+		uint8_t	detect_id = device_hash(detect_sig, disp) % DEVICE_COUNT;
 		DEVICE_TAG = &DEVICE_LIST[detect_id];
-		if (detect_sig == (uint32_t)pgm_read_dword(&DEVICE_TAG->signature)) {
+		if ((uint16_t)detect_sig == pgm_read_word(&DEVICE_TAG->signature)) {
 			DEVICE_ID = detect_id;
-			break;
+#ifndef FUSERESCUE_TIMING
+			memcpy_P(&PGM_TIME, &PGM_TIMING[pgm_read_byte(&device_memory()->timing)], sizeof PGM_TIME);
+#endif
 		}
 	}
-	// DEVICE_ID still unknown, not supported device detected
-	if (DEVICE_ID == UNKNOWN_DEVICE)
-		printf_P(PSTR("Signature:0x%06lX  UNKNOWN DEVICE\r\n"), detect_sig);
-	else {
-		// Detects the correct device
-		// Echo device type from device characteristics table
-		uint8_t		p;
-		const uint8_t	*p_buffer = DEVICE_TAG->device;
-		while ((p = pgm_read_byte(p_buffer++)))
-			Serial.write(p);
-		// Inquiry current fuse byte and lock byte
-		vf_fuse_low = read_fuse(_FUSE_BYTE_LOW);
-		vf_fuse_high = read_fuse(_FUSE_BYTE_HIGH);
-		vf_fuse_ext = read_fuse(_FUSE_BYTE_EXT);
-		vf_lock = read_fuse(_LOCK_BITS);
-		// Responds current byte value
-		printf_P(PSTR("(0x%06lX)\n\r  Fuse:0x%02X(low),0x%02X(high),0x%02X(ext)  Lock:0x%02X\n\r"),
-			detect_sig, vf_fuse_low, vf_fuse_high, vf_fuse_ext, vf_lock);
-	}
+	return detect_sig;
 }
 
 /**
@@ -520,21 +1201,9 @@ void FuseRescue::verify_device(void) {
  * @return	A read signature by long integer
  */
 uint32_t FuseRescue::read_signature(void) {
-	uint32_t	signature = 0L;
-
-	// Start parallel programming
-	start_pgm();
-	// Release the read signature command
-	load_command(CMD_READSIG);
-	// Capture the signature three consecutive bytes
-	for (uint8_t address = 0x00; address <= 0x02; address++) {
-		load_address_low(address);
-		signature = (signature << 8) + retrieve_data();
-	}
-	// Stop programming
-	end_pgm();
-
-	return signature;
+	job_start(JOB_SIGNATURE);
+	job_wait();
+	return job_result();
 }
 
 /**
@@ -557,6 +1226,9 @@ void FuseRescue::stable_signals(void) {
 	pinMode(XTAL1, INPUT);
 	for (uint8_t i = 0; i < 8; i++)
 		pinMode(PGM_DATA[i], INPUT);
+#ifdef PAGEL
+	pinMode(PAGEL, INPUT);
+#endif
 }
 
 /**
@@ -581,6 +1253,10 @@ void FuseRescue::setup_signals(void) {
 	pinMode(BS1, OUTPUT);
 	digitalWrite(BS2, LOW);
 	pinMode(BS2, OUTPUT);
+#ifdef PAGEL
+	digitalWrite(PAGEL, LOW);
+	pinMode(PAGEL, OUTPUT);
+#endif
 	// XTAL1 stillness
 	digitalWrite(XTAL1, LOW);
 	pinMode(XTAL1, OUTPUT);
@@ -593,17 +1269,21 @@ void FuseRescue::setup_signals(void) {
  * Launch parallel programming
  */
 void FuseRescue::start_pgm(void) {
+	TRACE(TRACE_BEGIN, TRACE_PHASE_START);
 	setup_signals();
 	// Enter the parallel programming mode
 	// VCC on, apply +12V
 	digitalWrite(VCC_ENABLE, HIGH);
-	delayMicroseconds(30);
+	TRACE_LEVEL(TRACE_VCC, HIGH);
+	delayMicroseconds(PGM_TIME.t_vcc);
 	digitalWrite(PGM_ENABLE, HIGH);
+	TRACE_LEVEL(TRACE_HV, HIGH);
 	// Wait until the + 12V supply is sufficiently
 	// Launch the parallel programming sequence
 	delayMicroseconds(10);
 	pinMode(RDYBSY, INPUT);
-	delayMicroseconds(300);
+	delayMicroseconds(PGM_TIME.t_enter);
+	TRACE(TRACE_END, TRACE_PHASE_START);
 }
 
 /**
@@ -612,16 +1292,124 @@ void FuseRescue::start_pgm(void) {
 void inline FuseRescue::end_pgm(void) {
 	// Exit the parallel programming mode
 	stable_signals();
+	TRACE_LEVEL(TRACE_HV, LOW);
+	TRACE_LEVEL(TRACE_VCC, LOW);
+}
+
+/**
+ * Programming session, only the outermost one powers the target
+ */
+uint8_t	FuseRescue::PgmSession::depth;
+
+FuseRescue::PgmSession::PgmSession() {
+	enter();
+}
+
+FuseRescue::PgmSession::~PgmSession() {
+	leave();
+}
+
+void FuseRescue::PgmSession::enter(void) {
+	if (depth++ == 0)
+		start_pgm();
+}
+
+void FuseRescue::PgmSession::leave(void) {
+	if (--depth == 0)
+		end_pgm();
+}
+
+/**
+ * Port registers which correspond to the port identifier of devicesig.h.
+ * The identifier is a constant at each call site, so the selection is
+ * folded at compile time and the access becomes a single I/O instruction.
+ */
+static inline volatile uint8_t &pgm_out(uint8_t port) {
+	return port == PGM_PORTB ? PORTB : (port == PGM_PORTC ? PORTC : PORTD);
+}
+
+static inline volatile uint8_t &pgm_dir(uint8_t port) {
+	return port == PGM_PORTB ? DDRB : (port == PGM_PORTC ? DDRC : DDRD);
+}
+
+static inline volatile uint8_t &pgm_in(uint8_t port) {
+	return port == PGM_PORTB ? PINB : (port == PGM_PORTC ? PINC : PIND);
 }
 
+/**
+ * Drive a single signal line without the digitalWrite overhead.
+ * @param	pin		Arduino pin number of the signal
+ * @param	level	HIGH or LOW
+ */
+static inline void line_write(uint8_t pin, uint8_t level) {
+	if (level)
+		pgm_out(pgm_port(pin)) |= pgm_mask(pin);
+	else
+		pgm_out(pgm_port(pin)) &= ~pgm_mask(pin);
+}
+
+/**
+ * Release the data byte to the data bus portion of a port and turn it to output.
+ * The port value is settled before the direction, so no glitch occurs on the bus.
+ */
+template <uint8_t PORT>
+static inline void bus_port_output(uint8_t data) {
+	if (pgm_data_bus<PORT>::mask) {
+		pgm_out(PORT) = (pgm_out(PORT) & ~pgm_data_bus<PORT>::mask) | pgm_data_bus<PORT>::scatter(data);
+		pgm_dir(PORT) |= pgm_data_bus<PORT>::mask;
+	}
+}
+
+/**
+ * Turn the data bus portion of a port to input without the pull-up.
+ */
+template <uint8_t PORT>
+static inline void bus_port_input(void) {
+	if (pgm_data_bus<PORT>::mask) {
+		pgm_dir(PORT) &= ~pgm_data_bus<PORT>::mask;
+		pgm_out(PORT) &= ~pgm_data_bus<PORT>::mask;
+	}
+}
+
+/**
+ * Switch XA1, XA0 and BS1 together with a masked write for each port.
+ */
+template <uint8_t PORT, bool xa1, bool xa0, bool bs1>
+static inline void port_action(void) {
+	const uint8_t	lines = pgm_line(PORT, XA1) | pgm_line(PORT, XA0) | pgm_line(PORT, BS1);
+	const uint8_t	level = pgm_line(PORT, XA1, xa1) | pgm_line(PORT, XA0, xa0) | pgm_line(PORT, BS1, bs1);
+	if (lines)
+		pgm_out(PORT) = (pgm_out(PORT) & ~lines) | level;
+}
+
+template <bool xa1, bool xa0, bool bs1>
+static inline void select_action(void) {
+	port_action<PGM_PORTB, xa1, xa0, bs1>();
+	port_action<PGM_PORTC, xa1, xa0, bs1>();
+	port_action<PGM_PORTD, xa1, xa0, bs1>();
+}
+
+#ifdef PINTRACE
+/**
+ * Trace XA1, XA0, BS1 and BS2 which are effective for the following strobe.
+ */
+static inline bool line_level(uint8_t pin) {
+	return pgm_out(pgm_port(pin)) & pgm_mask(pin);
+}
+
+static void trace_select(void) {
+	TRACE(TRACE_SELECT, line_level(XA1) << 3 | line_level(XA0) << 2 | line_level(BS1) << 1 | line_level(BS2));
+}
+#else
+#define	trace_select()	((void)0)
+#endif
+
 /**
  * Release a command byte
  * @param	command		A command byte
  */
 void FuseRescue::load_command(uint8_t command) {
-	digitalWrite(XA1, HIGH);
-	digitalWrite(XA0, LOW);
-	digitalWrite(BS1, LOW);
+	select_action<HIGH, LOW, LOW>();
 	transmit_data(command);
 }
 
@@ -630,9 +1418,16 @@ void FuseRescue::load_command(uint8_t command) {
  * @param	address		A address byte
  */
 void FuseRescue::load_address_low(uint8_t address) {
-	digitalWrite(XA1, LOW);
-	digitalWrite(XA0, LOW);
-	digitalWrite(BS1, LOW);
+	select_action<LOW, LOW, LOW>();
+	transmit_data(address);
+}
+
+/**
+ * Discharge a high address byte to data line
+ * @param	address		A high address byte
+ */
+void FuseRescue::load_address_high(uint8_t address) {
+	select_action<LOW, LOW, HIGH>();
 	transmit_data(address);
 }
 
@@ -641,33 +1436,59 @@ void FuseRescue::load_address_low(uint8_t address) {
  * @param	data		data byte
  */
 void FuseRescue::load_data(uint8_t data) {
-	digitalWrite(XA1, LOW);
-	digitalWrite(XA0, HIGH);
-	digitalWrite(BS1, LOW);
+	select_action<LOW, HIGH, LOW>();
+	transmit_data(data);
+}
+
+/**
+ * Release a high data byte
+ * @param	data		data byte
+ */
+void FuseRescue::load_data_high(uint8_t data) {
+	select_action<LOW, HIGH, HIGH>();
 	transmit_data(data);
 }
 
+#ifdef PAGEL
+/**
+ * Latch the loaded data bytes into the Flash page buffer.
+ * BS1 is still high from the high data byte loading.
+ */
+void FuseRescue::latch_data(void) {
+	line_write(PAGEL, HIGH);
+	TRACE_LEVEL(TRACE_PAGEL, HIGH);
+	delayMicroseconds(1);
+	line_write(PAGEL, LOW);
+	TRACE_LEVEL(TRACE_PAGEL, LOW);
+	delayMicroseconds(1);
+}
+#endif
+
 /**
  * Retrieve a data form the data line
  * @return	A data on the data line
  */
 uint8_t FuseRescue::retrieve_data(void) {
-	uint8_t	read_byte = 0x00;
-	int8_t	bit_count;
+	uint8_t	read_byte;
 
+	// Release the data line before the target drives it
+	bus_port_input<PGM_PORTB>();
+	bus_port_input<PGM_PORTC>();
+	bus_port_input<PGM_PORTD>();
 	// Receive the discharged 8 bit data on the line
-	digitalWrite(OE, LOW);
-	// Scan the data line and concatenate it to the byte
-	for (bit_count = 7; bit_count >= 0; bit_count--) {
-		read_byte <<= 1;
-		read_byte &= 0xFE;
-		pinMode(PGM_DATA[bit_count], INPUT);
-		if (digitalRead(PGM_DATA[bit_count]) == HIGH)
-			read_byte |= 0x01;
-	}
+	trace_select();
+	line_write(OE, LOW);
+	TRACE_LEVEL(TRACE_OE, LOW);
+	// Wait for the data valid from the target, and sample the whole data line at once
+	delayMicroseconds(PGM_TIME.t_oldv);
+	read_byte = pgm_data_bus<PGM_PORTB>::gather(pgm_in(PGM_PORTB))
+			| pgm_data_bus<PGM_PORTC>::gather(pgm_in(PGM_PORTC))
+			| pgm_data_bus<PGM_PORTD>::gather(pgm_in(PGM_PORTD));
 	// Close the data line
-	digitalWrite(OE, HIGH);
-	delay(1);
+	line_write(OE, HIGH);
+	TRACE_LEVEL(TRACE_OE, HIGH);
+	TRACE(TRACE_BUS_IN, read_byte);
+	delayMicroseconds(PGM_TIME.t_ohdz);
 
 	return read_byte;
 }
@@ -678,27 +1499,316 @@ uint8_t FuseRescue::retrieve_data(void) {
  */
 void FuseRescue::transmit_data(uint8_t data) {
 	// Change signal direction for data line and release data
-	for (uint8_t bit_count = 0; bit_count < 8; bit_count++) {
-		pinMode(PGM_DATA[bit_count], OUTPUT);
-		digitalWrite(PGM_DATA[bit_count], data & 0x01);
-		data >>= 1;
-	}
+	bus_port_output<PGM_PORTB>(data);
+	bus_port_output<PGM_PORTC>(data);
+	bus_port_output<PGM_PORTD>(data);
+	trace_select();
+	TRACE(TRACE_BUS_OUT, data);
 	// Give XTAL1 a positive pulse, this loads the command.
-	digitalWrite(XTAL1, HIGH);
+	line_write(XTAL1, HIGH);
+	TRACE_LEVEL(TRACE_XTAL1, HIGH);
 	delayMicroseconds(1);
-	digitalWrite(XTAL1, LOW);
+	line_write(XTAL1, LOW);
+	TRACE_LEVEL(TRACE_XTAL1, LOW);
 	delayMicroseconds(1);
 }
 
 /**
- * Write to memory for latched data
+ * Stamp the rising edge of RDY/#BSY, PCINT0 covers the pins of PORTB.
+ */
+static_assert(pgm_port(RDYBSY) == PGM_PORTB, "RDY/#BSY must be on PORTB for PCINT0");
+ISR(PCINT0_vect) {
+	if (pgm_in(PGM_PORTB) & pgm_mask(RDYBSY)) {
+		BUSY_TICKS = TCNT1;
+		BUSY_READY = true;
+		TRACE_LEVEL(TRACE_RDY, HIGH);
+	}
+}
+
+/**
+ * Pulse #WR to write the latched data and time the busy period with
+ * Timer1 from the pulse, the pin change interrupt stamps RDY/#BSY.
+ */
+static void busy_begin(void) {
+	TCCR1A = 0;
+	TCCR1B = (1 << CS11) | (1 << CS10);
+	BUSY_READY = false;
+	PCMSK0 |= pgm_mask(RDYBSY);
+	PCIFR = (1 << PCIF0);
+	PCICR |= (1 << PCIE0);
+	trace_select();
+	TRACE(TRACE_BEGIN, TRACE_PHASE_BUSY);
+	TCNT1 = 0;
+	// Signal the writing pulse, #WR is held low for t_WLWH of 150ns at least
+	line_write(WR, LOW);
+	delayMicroseconds(1);
+	line_write(WR, HIGH);
+	// The edges are stamped after the pulse
+	TRACE_LEVEL(TRACE_WR, LOW);
+	TRACE_LEVEL(TRACE_WR, HIGH);
+	TRACE_LEVEL(TRACE_RDY, LOW);
+}
+
+/**
+ * Stop the busy period capture.
+ * @return	Busy period by microseconds, 0 if time-out occurred
+ */
+static uint16_t busy_end(void) {
+	PCICR &= ~(1 << PCIE0);
+	PCMSK0 &= ~pgm_mask(RDYBSY);
+	TRACE(TRACE_END, TRACE_PHASE_BUSY);
+
+	if (CMD_TIMEOUT)
+		return 0;
+	return BUSY_TICKS > 0xFFFF / BUSY_TICK_US ? 0xFFFF : BUSY_TICKS * BUSY_TICK_US;
+}
+
+/**
+ * Write to memory for latched data.
+ * The CPU sleeps while RDY/#BSY is busy, the pin change interrupt or
+ * the time-out trap wakes it up.
+ * @return	Busy period by microseconds, 0 if time-out occurred
  */
-void FuseRescue::persist_data(void) {
-	// Execute #WR pulse to persist a sent data
+uint16_t FuseRescue::persist_data(void) {
 	trap_timeout(OPCMD_TRAP_TIMEOUT);	// Set time-out trap
-	digitalWrite(WR, LOW);				// Signal the writing pulse
-	digitalWrite(WR, HIGH);
-	delayMicroseconds(1);				// Stabilize the write completion
-	while (!digitalRead(RDYBSY));		// Waiting for erasing completely
+	busy_begin();
+	// Waiting for writing completely
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	cli();
+	while (!BUSY_READY && !CMD_TIMEOUT) {
+		sleep_enable();
+		sei();							// Sleep is executed before any interrupt
+		sleep_cpu();
+		sleep_disable();
+		cli();
+	}
+	sei();
 	reset_timeout();					// Release the trap for time-out
-}
\ No newline at end of file
+	return busy_end();
+}
+
+/**
+ * Tick of the job
+ */
+static void job_tick(void) {
+	JOB_TICKS++;
+}
+
+static uint16_t job_ticks(void) {
+	uint8_t		sreg = SREG;
+	uint16_t	ticks;
+
+	cli();
+	ticks = JOB_TICKS;
+	SREG = sreg;
+	return ticks;
+}
+
+static void job_step(JOB_STEP step) {
+	JOB.step = step;
+	JOB.since = job_ticks();
+}
+
+/**
+ * Terminate the job, the session held by the job is closed.
+ * @param	state	Final state of the job
+ */
+static void job_finish(FuseRescue::JOB_STATE state) {
+	if (JOB.powered) {
+		FuseRescue::PgmSession::leave();
+		JOB.powered = false;
+	}
+	MsTimer2::stop();
+	CMD_TIMEOUT = state != FuseRescue::JOB_DONE;
+	JOB.state = state;
+}
+
+/**
+ * Start a job, the job is advanced by job_poll() from job_wait().
+ * @param	kind	Kind of the job
+ * @param	loc		Fuse byte location to be written by JOB_WRITE
+ * @param	value	Fuse byte to be written by JOB_WRITE
+ * @return	false if another job is running
+ */
+bool FuseRescue::job_start(JOB_KIND kind, LOC_FUSE_BYTE loc, uint8_t value) {
+	if (JOB.state == JOB_RUNNING)
+		return false;
+	JOB.kind = kind;
+	JOB.loc = loc;
+	JOB.value = value;
+	JOB.index = 0;
+	JOB.r_try = 0;
+	JOB.abort = false;
+	JOB.result = 0L;
+	JOB.state = JOB_RUNNING;
+	CMD_TIMEOUT = false;
+	MsTimer2::set(JOB_TICK_MS, job_tick);
+	MsTimer2::start();
+	JOB.begin = job_ticks();
+	job_step(STEP_POWER);
+	return true;
+}
+
+/**
+ * Advance the running job until it has to wait for the target.
+ * The reading advances a byte at each call.
+ * The writing is attempted up to OPCMD_RETRY_MAX until the verified byte
+ * matches, and the chip erase is attempted up to OPCMD_RETRY_MAX while
+ * RDY/#BSY times out with the power cycle.
+ * The abort waits for RDY/#BSY, the target is not powered off while it
+ * is programming. It also waits for the power-up after the discharge, so
+ * the session of the caller is kept powered.
+ * @return	State of the job
+ */
+FuseRescue::JOB_STATE FuseRescue::job_poll(void) {
+	while (JOB.state == JOB_RUNNING) {
+		uint16_t	elapsed = job_ticks() - JOB.since;
+
+		if (JOB.abort && JOB.step != STEP_BUSY && JOB.step != STEP_DISCHARGE) {
+			// The byte may have been written without the verify
+			if (JOB.kind == JOB_WRITE)
+				TARGET_VALID &= ~_BV(JOB.loc);
+			job_finish(JOB_ABORTED);
+			break;
+		}
+		switch (JOB.step) {
+		case STEP_POWER:
+			PgmSession::enter();
+			JOB.powered = true;
+			job_step(JOB.kind == JOB_WRITE || JOB.kind == JOB_ERASE ? STEP_ISSUE : STEP_READ);
+			break;
+		case STEP_ISSUE:
+			if (JOB.kind == JOB_ERASE)
+				load_command(CMD_CHIPERASE);
+			else {
+				load_command(JOB.loc == _LOCK_BITS ? CMD_WRITELOCK : CMD_WRITEFUSE);
+				load_data(JOB.value);		// Enables data loading
+				// Specify Fuse byte location, the low byte and Lock bits keep BS1 and BS2 low
+				if (JOB.loc == _FUSE_BYTE_HIGH)
+					digitalWrite(BS1, HIGH);
+				else if (JOB.loc == _FUSE_BYTE_EXT)
+					digitalWrite(BS2, HIGH);
+			}
+			busy_begin();
+			job_step(STEP_BUSY);
+			break;
+		case STEP_BUSY:
+			if (!BUSY_READY && elapsed < OPCMD_TRAP_TIMEOUT)
+				return JOB.state;
+			CMD_TIMEOUT = !BUSY_READY;
+			BUSY_TIME[JOB.kind == JOB_ERASE ? BUSY_ERASE : (JOB.loc == _LOCK_BITS ? BUSY_LOCK : BUSY_FUSE)] = busy_end();
+			if (JOB.kind == JOB_WRITE) {
+				// Terminate the Fuse Writing
+				digitalWrite(BS1, LOW);
+				digitalWrite(BS2, LOW);
+				if (!CMD_TIMEOUT)
+					job_step(STEP_VERIFY);
+				else {
+					TARGET_VALID &= ~_BV(JOB.loc);
+					job_finish(JOB_TIMEOUT);
+				}
+			} else {
+				// Chip erase clears the Lock bits, the Fuse bytes are kept
+				TARGET_VALID &= ~_BV(_LOCK_BITS);
+				if (!CMD_TIMEOUT)
+					job_finish(JOB_DONE);
+				else if (++JOB.r_try < OPCMD_RETRY_MAX) {
+					// Let the target discharge before powering it up again.
+					// The power is cycled under the session of the caller.
+					end_pgm();
+					job_step(STEP_DISCHARGE);
+				} else
+					job_finish(JOB_TIMEOUT);
+			}
+			break;
+		case STEP_VERIFY:
+			JOB.result = read_fuse(JOB.loc);
+			if (JOB.result != JOB.value && ++JOB.r_try <= OPCMD_RETRY_MAX)
+				job_step(STEP_ISSUE);
+			else {
+				// The verified byte is the current state of the target
+				TARGET_FUSE[JOB.loc] = (uint8_t)JOB.result;
+				TARGET_VALID |= _BV(JOB.loc);
+				job_step(STEP_SETTLE);
+			}
+			break;
+		case STEP_SETTLE:
+			if (elapsed < PGM_TIME.t_settle)
+				return JOB.state;
+			job_finish(JOB_DONE);
+			break;
+		case STEP_DISCHARGE:
+			if (elapsed < PGM_DISCHARGE)
+				return JOB.state;
+			start_pgm();
+			job_step(STEP_ISSUE);
+			break;
+		case STEP_READ:
+			if (JOB.kind == JOB_SIGNATURE) {
+				// Capture the signature three consecutive bytes
+				if (JOB.index == 0)
+					load_command(CMD_READSIG);
+				load_address_low(JOB.index);
+				JOB.result = (JOB.result << 8) + retrieve_data();
+				if (++JOB.index > 0x02)
+					job_finish(JOB_DONE);
+			} else {
+				// All the Fuse bytes and Lock bits refresh the cached state
+				TARGET_FUSE[JOB.index] = read_fuse((LOC_FUSE_BYTE)JOB.index);
+				TARGET_VALID |= _BV(JOB.index);
+				if (++JOB.index > _LOCK_BITS)
+					job_finish(JOB_DONE);
+			}
+			return JOB.state;
+		}
+	}
+	return JOB.state;
+}
+
+/**
+ * Drive the running job to the end. The CPU sleeps while the job waits
+ * for the target, the tick or RDY/#BSY wakes it up. On the terminal, ESC
+ * aborts the job, a command letter is queued as the next command and a
+ * dot is put at each JOB_PROGRESS_MS for the progress.
+ * @return	Final state of the job
+ */
+FuseRescue::JOB_STATE FuseRescue::job_wait(void) {
+	uint16_t	dots = 0;
+
+	while (job_poll() == JOB_RUNNING) {
+		if (!FRAME_MODE) {
+			if (Serial.available() && Serial.peek() != FRAME_STX) {
+				char	c = Serial.read();
+				if (isalpha(c))
+					c &= 0xdf;
+				if (c == OPCMD_ABORT)
+					job_abort();
+				else if (c && strchr(CMD_LEXDEFINE, c))
+					CMD_NEXT = c;
+			}
+			for (uint16_t progress = (job_ticks() - JOB.begin) / JOB_PROGRESS_MS; dots < progress; dots++)
+				Serial.write('.');
+		}
+		if (JOB.step == STEP_BUSY || JOB.step == STEP_SETTLE || JOB.step == STEP_DISCHARGE) {
+			set_sleep_mode(SLEEP_MODE_IDLE);
+			sleep_mode();
+		}
+	}
+	return JOB.state;
+}
+
+/**
+ * Request to abort the running job, the target is powered off at the
+ * next job_poll() even if it is busy.
+ */
+void FuseRescue::job_abort(void) {
+	if (JOB.state == JOB_RUNNING)
+		JOB.abort = true;
+}
+
+/**
+ * @return	Signature of JOB_SIGNATURE or the verified byte of JOB_WRITE
+ */
+uint32_t FuseRescue::job_result(void) {
+	return JOB.result;
+}
@@ -11,6 +11,20 @@
 #include "WProgram.h"
 #endif
 #include "devicesig.h"
+#include "SramArena.h"
+#include "PinTrace.h"
+
+// Serial baud rate at startup, and the rates which can be switched to at
+// runtime by the binary protocol with the index of the list.
+#ifndef FUSERESCUE_BAUDRATE
+#define FUSERESCUE_BAUDRATE	9600
+#endif
+#define FUSERESCUE_BAUD_RATES	9600, 19200, 38400, 57600, 115200, 250000, 500000, 1000000
+
+// Timing profile of the parallel programming, the profile is selected by
+// the identified device unless it is fixed by defining FUSERESCUE_TIMING
+// with one of PGM_TIMING_XXX in devicesig.h.
+//#define FUSERESCUE_TIMING	PGM_TIMING_SAFE
 
 namespace FuseRescue {
 	// Retention of the current value for updating the fuse byte and byte lock
@@ -18,18 +32,56 @@ namespace FuseRescue {
 	// DEVICE_ID is index of the array which identified by the device signature
 	// that currently targeted.
 	extern uint8_t	DEVICE_ID;					// Device identify signature
+	// Busy period of RDY/#BSY measured at the last operation for each
+	// kind by microseconds, 0 if it timed out.
+	typedef enum {
+		BUSY_FUSE,
+		BUSY_LOCK,
+		BUSY_ERASE,
+		BUSY_FLASH,
+		_BUSY_KINDS
+	} BUSY_KIND;
+	extern uint16_t	BUSY_TIME[];
+	// Operations which run as a job, the job is advanced step by step by
+	// job_poll() and it returns while the target is busy. job_wait() drives
+	// a job to the end and serves the terminal meanwhile. Only one job runs
+	// at a time.
+	typedef enum {
+		JOB_SIGNATURE,							// Read the signature bytes
+		JOB_FUSES,								// Read all the Fuse bytes and Lock bits
+		JOB_WRITE,								// Write a Fuse byte or Lock bits with verify
+		JOB_ERASE								// Chip erase
+	} JOB_KIND;
+	typedef enum {
+		JOB_IDLE,
+		JOB_RUNNING,
+		JOB_DONE,
+		JOB_TIMEOUT,							// RDY/#BSY time-out
+		JOB_ABORTED
+	} JOB_STATE;
 
 	void	setup();							// Setup for the Sketch
 	void	loop();								// Process of the Sketch
 	char	inquiry(const char *, const char *, bool);	// Enter a query response
 	int16_t	inquiry_hex(const char *);			// Enter hexadecimal value
+	void	frame_command(void);				// Process a frame of binary protocol
 	void	write_fuse_each(uint8_t);			// Write Fuse byte one by one
 	void	write_fuse_default(void);			// Write default Fuse byte
 	uint8_t	write_fuse(LOC_FUSE_BYTE, uint8_t);	// Write Fuse byte at a address
 	void	write_lock_bits(void);				// Write Lock bits
 	uint8_t	read_fuse(LOC_FUSE_BYTE);			// Read the Fuse byte at a address
+	uint8_t	cached_fuse(LOC_FUSE_BYTE);			// Fuse byte from the cached target state
+	bool	target_changed(void);				// Detect the replacement of the target
 	void	erase_device(void);					// Erase the Flash, Lock bits
+	void	erase_chip(void);					// Execute chip erase without inquiry
+#ifdef PAGEL
+	void	write_flash(void);					// Write Flash from Intel HEX records
+	void	program_page(uint16_t, const uint8_t *);	// Program a Flash page
+#endif
 	void	verify_device(void);				// Device verification
+	uint32_t identify_device(void);				// Identify the device by the signature
+	void	dump_device(void);					// Dump the Flash and EEPROM
+	void	send_hex_record(uint16_t, uint8_t, const uint8_t *, uint8_t);	// Send a Intel HEX record
 	uint32_t read_signature(void);				// Read the chip signature bytes
 	void	stable_signals(void);				// Turn off programming signals
 	void	setup_signals(void);				// Setup the each programming signal
@@ -37,10 +89,37 @@ namespace FuseRescue {
 	void	inline end_pgm(void);				// Parallel programing termination
 	void	load_command(uint8_t);				// Release a command byte
 	void	load_address_low(uint8_t);			// Discharge a address byte to data line
+	void	load_address_high(uint8_t);			// Discharge a high address byte to data line
 	void	load_data(uint8_t);					// Release a data byte
+	void	load_data_high(uint8_t);			// Release a high data byte
+#ifdef PAGEL
+	void	latch_data(void);					// Latch the data bytes into the page buffer
+#endif
 	uint8_t retrieve_data(void);				// Retrieve a data form the data line
 	void	transmit_data(uint8_t);				// Latch a data
-	void	persist_data(void);					// Write to memory for latched data
+	uint16_t persist_data(void);				// Write to memory for latched data
+	bool	job_start(JOB_KIND, LOC_FUSE_BYTE = _FUSE_BYTE_LOW, uint8_t = 0);	// Start a job
+	JOB_STATE job_poll(void);					// Advance the running job
+	JOB_STATE job_wait(void);					// Drive the job to the end
+	void	job_abort(void);					// Request to abort the running job
+	uint32_t job_result(void);					// Signature or verified byte of the last job
+
+	// Scoped parallel programming session.
+	// The outermost session powers up the target by start_pgm() and
+	// turns it off by end_pgm() at the end of its scope. The nested
+	// sessions share the power-up, so the operations which open their
+	// own session run without the power cycle inside an outer one.
+	// A job holds the session across its steps by enter() and leave().
+	class PgmSession {
+	public:
+		PgmSession();
+		~PgmSession();
+		static void	enter(void);				// Open a session without the scope
+		static void	leave(void);				// Close the session opened by enter()
+	private:
+		static uint8_t	depth;					// Nesting level of the sessions
+	};
+
 	// Time-out trapper declaration
 	void	trap_timeout(uint8_t);			// Start timer for catch time-out
 	void inline catch_timeout(void);		// Time-out trap routine
@@ -31,15 +31,91 @@
 #define	DATA5		6		//	DATA5:		 D6:	PB5
 #define	DATA6		8		//	DATA6:		 D8:	PC0
 #define	DATA7		9		//	DATA7:		 D9:	PBC
+// PAGEL latches the Flash page data. It is pulled down with 10K ohm on the
+// shield because the Uno has no spare pin for it. If a PAGEL line is wired
+// to the target PD7, define it here to enable the Flash page programming.
+//#define	PAGEL		?		//	PAGEL:		  ?:	PD7
 // The signal series input and output by sequenced data
-const uint8_t	PGM_DATA[] = { DATA0, DATA1, DATA2, DATA3, DATA4, DATA5, DATA6, DATA7 };
+constexpr uint8_t	PGM_DATA[] = { DATA0, DATA1, DATA2, DATA3, DATA4, DATA5, DATA6, DATA7 };
+
+// Port map of the above pins on the Arduino Uno.
+// D0-D7 belong to PORTD, D8-D13 belong to PORTB and A0-A5 belong to PORTC.
+// Each pin is resolved to its port and bit mask at compile time, so that
+// the data bus and the control lines can be driven with a few masked port
+// operations instead of digitalWrite/digitalRead for each bit.
+#define	PGM_PORTB	0
+#define	PGM_PORTC	1
+#define	PGM_PORTD	2
+constexpr uint8_t pgm_port(uint8_t pin) {
+	return pin < 8 ? PGM_PORTD : (pin < 14 ? PGM_PORTB : PGM_PORTC);
+}
+constexpr uint8_t pgm_mask(uint8_t pin) {
+	return 1 << (pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14));
+}
+// Bit mask of a pin if it belongs to the port and the level is active
+constexpr uint8_t pgm_line(uint8_t port, uint8_t pin, bool level = true) {
+	return (pgm_port(pin) == port && level) ? pgm_mask(pin) : 0;
+}
+
+// Data bus composition within a port.
+// mask is the data lines assigned to the port, scatter() deploys the data
+// bits to the port bits and gather() collects the data bits from the port.
+template <uint8_t PORT, uint8_t BIT = 0>
+struct pgm_data_bus {
+	static constexpr uint8_t	mask = pgm_line(PORT, PGM_DATA[BIT]) | pgm_data_bus<PORT, BIT + 1>::mask;
+	static inline uint8_t scatter(uint8_t data) {
+		return pgm_line(PORT, PGM_DATA[BIT], data & (1 << BIT)) | pgm_data_bus<PORT, BIT + 1>::scatter(data);
+	}
+	static inline uint8_t gather(uint8_t pins) {
+		return ((pins & pgm_line(PORT, PGM_DATA[BIT])) ? (1 << BIT) : 0) | pgm_data_bus<PORT, BIT + 1>::gather(pins);
+	}
+};
+template <uint8_t PORT>
+struct pgm_data_bus<PORT, 8> {
+	static constexpr uint8_t	mask = 0;
+	static inline uint8_t scatter(uint8_t) { return 0; }
+	static inline uint8_t gather(uint8_t) { return 0; }
+};
 
 // Parallel programming command codes
 #define	CMD_CHIPERASE	B10000000			// Erase device
 #define	CMD_WRITEFUSE	B01000000			// Write Fuse byte
 #define	CMD_WRITELOCK	B00100000			// Write Lock byte
+#define	CMD_WRITEFLASH	B00010000			// Write Flash
+#define	CMD_NOOP		B00000000			// No operation
 #define	CMD_READSIG		B00001000			// Read Signature
 #define	CMD_READFUSE	B00000100			// Read Fuse byte
+#define	CMD_READEEPROM	B00000011			// Read EEPROM
+#define	CMD_READFLASH	B00000010			// Read Flash
+
+// Parallel programming timing profile.
+// Each wait is the datasheet minimum of the device family, the "safe"
+// profile holds the conservative waits which apply while the device has
+// not been identified yet.
+typedef	struct	_pgm_timing {
+	uint8_t		t_vcc;						// VCC on to +12V on #RESET (us)
+	uint16_t	t_enter;					// +12V on #RESET to the first command (us)
+	uint8_t		t_oldv;						// #OE low to the data valid, t_OLDV (us)
+	uint16_t	t_ohdz;						// #OE high to the data line released, t_OHDZ (us)
+	uint8_t		t_settle;					// Settling after writing Fuse or Lock (ms)
+} pgm_timing_t;
+// Profile identifier, index of PGM_TIMING
+#define	PGM_TIMING_SAFE		0
+#define	PGM_TIMING_MEGA8	1				// ATmega8
+#define	PGM_TIMING_MEGAX8	2				// ATmega48/88/168/328 family
+// The ATmega48/88/168/328 family takes +12V 20-60us after VCC and the
+// first command 300us after +12V, the ATmega8 takes +12V 100us after VCC
+// and the first command 50us after +12V. The safe profile keeps the
+// window of the family, which has the upper bound.
+// The table is read by memcpy_P into the profile in effect.
+constexpr pgm_timing_t	PGM_TIMING[] PROGMEM = {
+	{  30, 300, 1, 1000, 100 },
+	{ 120, 100, 1,    1,   0 },
+	{  30, 300, 1,    1,   0 }
+};
+// VCC off to the target discharged (ms). It is the time of the capacitor on
+// the VCC line of the shield, not of the device.
+#define	PGM_DISCHARGE		100
 
 // Identifier indicating the byte for reading the fuse
 typedef enum {
@@ -49,31 +125,47 @@ typedef enum {
 	_LOCK_BITS
 } LOC_FUSE_BYTE;
 
-// Container for the supported device characteristics
-// Signature contains device signature byte
-// A EEPROM size contains size of EEPROM
-// Default fuse byte contains factory settings
-typedef	struct	_device_sig {
-	uint8_t		device[16];					// Chip name
-	uint32_t	signature;					// signature byte
+// Compact records of the supported device characteristics.
+// The table is generated by tools/devicegen.py from tools/devices.txt into
+// devicetab.h, the names, the Fuse bytes and the memory geometries are
+// shared records which are referred to by index from each device.
+// Memory geometry, Flash size and page size are counted by words
+typedef	struct	_device_mem {
 	uint16_t	eeprom_size;				// Size of EEPROM
-	uint8_t		default_fuse[3];			// Chip default Fuse
-	uint8_t		bt_fuse[3];					// Arduino bootloader Fuse
-} device_sig_t;
-// Device characteristics implementation
-const device_sig_t DEVICE_LIST[] PROGMEM = {
-	{"ATmega8"    , 0x1E9307,  256, {0xE1, 0xD9, 0xFF}, {0xE2, 0xDD, 0x77} },
-	{"ATmega48A"  , 0x1E9205,  256, {0x62, 0xDF, 0xFF}, {0xE2, 0xDD, 0x77} },
-	{"ATmega48PA" , 0x1E920A,  256, {0x62, 0xDF, 0xFF}, {0xE2, 0xDD, 0x77} },
-	{"ATmega88A"  , 0x1E930A,  512, {0x62, 0xDF, 0xF9}, {0xE2, 0xDD, 0x77} },
-	{"ATmega88PA" , 0x1E930F,  512, {0x62, 0xDF, 0xF9}, {0xE2, 0xDD, 0x77} },
-	{"ATmega168A" , 0x1E9406,  512, {0x62, 0xDF, 0xF9}, {0xFF, 0xDD, 0x00} },
-	{"ATmega168PA", 0x1E940B,  512, {0x62, 0xDF, 0xF9}, {0xFF, 0xDD, 0x00} },
-	{"ATmega328"  , 0x1E9514, 1024, {0x62, 0xD9, 0xFF}, {0xFF, 0xDA, 0x05} },
-	{"ATmega328P" , 0x1E950F, 1024, {0x62, 0xD9, 0xFF}, {0xFF, 0xDE, 0x05} }
-};
+	uint16_t	flash_size;					// Size of Flash in words
+	uint8_t		page_size;					// Flash page size in words
+	uint8_t		timing;						// Timing profile identifier
+} device_mem_t;
+// Device entry
+typedef	struct	_device_rec {
+	uint16_t	signature;					// Signature bytes following DEVICE_VENDOR
+	uint16_t	name;						// Offset of the name in DEVICE_NAMES
+	uint8_t		prefix;						// Offset of the family in DEVICE_PREFIXES
+	uint8_t		memory;						// Index of DEVICE_MEMORY
+	uint8_t		default_fuse;				// Index of DEVICE_FUSES, chip default Fuse
+	uint8_t		bt_fuse;					// Index of DEVICE_FUSES, Arduino bootloader Fuse
+} device_rec_t;
+// The first signature byte is the manufacturer code, it is common
+#define	DEVICE_VENDOR	0x1E
+
+// Minimal perfect hash of the signature.
+// The signature selects a bucket by device_hash() without the seed, and
+// the displacement of the bucket seeds device_hash() to reach the slot of
+// DEVICE_LIST, both are the remainder by DEVICE_BUCKETS and DEVICE_COUNT.
+// The lookup is two hash calculations regardless of the table size.
+// devicegen.py finds the displacements by the same hash.
+constexpr uint32_t device_fnv(uint32_t h, uint8_t b) {
+	return (h ^ b) * 16777619UL;
+}
+constexpr uint32_t device_hash(uint32_t sig, uint8_t seed) {
+	return device_fnv(device_fnv(device_fnv(2166136261UL ^ seed,
+		(uint8_t)(sig >> 16)), (uint8_t)(sig >> 8)), (uint8_t)sig);
+}
 
 // it would be held the UNKNOWN that the supported device could not be detected.
 #define UNKNOWN_DEVICE	0xff
 
+// Generated device table
+#include "devicetab.h"
+
 #endif	/* __DEVICESIG_H__ */
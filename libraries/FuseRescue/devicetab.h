@@ -0,0 +1,60 @@
+#ifndef	__DEVICETAB_H__
+#define	__DEVICETAB_H__
+
+//	devicetab.h
+//	This sketch licensed under the MIT License (MIT)
+//	Copyright (c) 2015 hieromon@gmail.com
+//	Generated by tools/devicegen.py from tools/devices.txt, do not edit.
+
+#define	DEVICE_COUNT	9
+#define	DEVICE_BUCKETS	5
+// The largest Flash page in bytes among the devices
+#define	MAX_PAGE_BYTES	128
+
+// Chip name is the family prefix followed by the rest of the name
+const char	DEVICE_PREFIXES[] PROGMEM = "ATmega\0";
+const char	DEVICE_NAMES[] PROGMEM = "168PA\0" "168A\0" "328P\0" "48PA\0" "88PA\0" "328\0" "48A\0" "88A\0";
+// Fuse bytes of low, high and ext
+const uint8_t	DEVICE_FUSES[][3] PROGMEM = {
+	{0xE1, 0xD9, 0xFF},
+	{0x62, 0xDF, 0xFF},
+	{0x62, 0xDF, 0xF9},
+	{0x62, 0xD9, 0xFF},
+	{0xE2, 0xDD, 0x77},
+	{0xFF, 0xDD, 0x00},
+	{0xFF, 0xDA, 0x05},
+	{0xFF, 0xDE, 0x05}
+};
+const device_mem_t	DEVICE_MEMORY[] PROGMEM = {
+	{  512,  4096,  32, PGM_TIMING_MEGA8},
+	{  256,  2048,  32, PGM_TIMING_MEGAX8},
+	{  512,  4096,  32, PGM_TIMING_MEGAX8},
+	{  512,  8192,  64, PGM_TIMING_MEGAX8},
+	{ 1024, 16384,  64, PGM_TIMING_MEGAX8}
+};
+// Displacement of each bucket of the perfect hash
+const uint8_t	DEVICE_DISP[DEVICE_BUCKETS] PROGMEM = { 1, 12, 0, 2, 12 };
+// Each entry is placed at the slot of its signature
+const device_rec_t	DEVICE_LIST[DEVICE_COUNT] PROGMEM = {
+	{0x950F,  11,  0,  4,  3,  7},	// ATmega328P
+	{0x940B,   0,  0,  3,  2,  5},	// ATmega168PA
+	{0x930F,  21,  0,  2,  2,  4},	// ATmega88PA
+	{0x930A,  34,  0,  2,  2,  4},	// ATmega88A
+	{0x9514,  26,  0,  4,  3,  6},	// ATmega328
+	{0x9406,   6,  0,  3,  2,  5},	// ATmega168A
+	{0x9205,  30,  0,  1,  1,  4},	// ATmega48A
+	{0x920A,  16,  0,  1,  1,  4},	// ATmega48PA
+	{0x9307,  28,  0,  0,  0,  4} 	// ATmega8
+};
+// The hash of devicesig.h reaches the same slots
+static_assert(device_hash(0x1E950F, 0) % DEVICE_BUCKETS == 4 && device_hash(0x1E950F, 12) % DEVICE_COUNT == 0, "ATmega328P");
+static_assert(device_hash(0x1E940B, 0) % DEVICE_BUCKETS == 3 && device_hash(0x1E940B, 2) % DEVICE_COUNT == 1, "ATmega168PA");
+static_assert(device_hash(0x1E930F, 0) % DEVICE_BUCKETS == 3 && device_hash(0x1E930F, 2) % DEVICE_COUNT == 2, "ATmega88PA");
+static_assert(device_hash(0x1E930A, 0) % DEVICE_BUCKETS == 0 && device_hash(0x1E930A, 1) % DEVICE_COUNT == 3, "ATmega88A");
+static_assert(device_hash(0x1E9514, 0) % DEVICE_BUCKETS == 0 && device_hash(0x1E9514, 1) % DEVICE_COUNT == 4, "ATmega328");
+static_assert(device_hash(0x1E9406, 0) % DEVICE_BUCKETS == 3 && device_hash(0x1E9406, 2) % DEVICE_COUNT == 5, "ATmega168A");
+static_assert(device_hash(0x1E9205, 0) % DEVICE_BUCKETS == 0 && device_hash(0x1E9205, 1) % DEVICE_COUNT == 6, "ATmega48A");
+static_assert(device_hash(0x1E920A, 0) % DEVICE_BUCKETS == 4 && device_hash(0x1E920A, 12) % DEVICE_COUNT == 7, "ATmega48PA");
+static_assert(device_hash(0x1E9307, 0) % DEVICE_BUCKETS == 1 && device_hash(0x1E9307, 12) % DEVICE_COUNT == 8, "ATmega8");
+
+#endif	/* __DEVICETAB_H__ */
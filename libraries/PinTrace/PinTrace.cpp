@@ -0,0 +1,77 @@
+//	PinTrace.cpp
+//	This sketch licensed under the MIT License (MIT)
+//	Copyright (c) 2015 hieromon@gmail.com
+//
+//	The ring buffer keeps the latest PINTRACE events, the older events are
+//	overwritten. A record holds only the lower 16 bits of the time stamp,
+//	a TRACE_GAP event precedes the record which comes 65536us or more after
+//	the previous one.
+
+#include "PinTrace.h"
+
+#ifdef PINTRACE
+#include <avr/interrupt.h>
+
+typedef struct {
+	uint16_t	stamp;						// Lower 16 bits of micros()
+	uint8_t		kind;
+	uint8_t		value;
+} trace_rec_t;
+
+static trace_rec_t	TRACE_RING[PINTRACE];
+static uint16_t	TRACE_HEAD;					// Next position to record
+static uint16_t	TRACE_COUNT;				// Valid records
+static uint32_t	TRACE_LAST;					// Time stamp of the last record
+
+static void push(uint16_t stamp, uint8_t kind, uint8_t value) {
+	trace_rec_t	*rec = &TRACE_RING[TRACE_HEAD];
+
+	rec->stamp = stamp;
+	rec->kind = kind;
+	rec->value = value;
+	if (++TRACE_HEAD >= PINTRACE)
+		TRACE_HEAD = 0;
+	if (TRACE_COUNT < PINTRACE)
+		TRACE_COUNT++;
+}
+
+/**
+ * Add an event, it can be called from the interrupt handler.
+ * @param	kind	TRACE_xxx event kind
+ * @param	value	Value of the event
+ */
+void PinTrace::record(uint8_t kind, uint8_t value) {
+	uint8_t		sreg = SREG;
+	uint32_t	now = micros();
+	uint32_t	gap;
+
+	cli();
+	gap = (now - TRACE_LAST) >> 16;
+	if (TRACE_COUNT && gap)
+		push((uint16_t)TRACE_LAST, TRACE_GAP, gap > 0xFF ? 0xFF : (uint8_t)gap);
+	TRACE_LAST = now;
+	push((uint16_t)now, kind, value);
+	SREG = sreg;
+}
+
+/**
+ * Send the events from the oldest by Serial, and clear them.
+ */
+void PinTrace::dump(void) {
+	uint16_t	count, pos;
+
+	cli();
+	count = TRACE_COUNT;
+	pos = (TRACE_HEAD + PINTRACE - count) % PINTRACE;
+	TRACE_COUNT = 0;
+	sei();
+	Serial.write((const uint8_t *)TRACE_MAGIC, sizeof TRACE_MAGIC - 1);
+	Serial.write((uint8_t)count);
+	Serial.write((uint8_t)(count >> 8));
+	while (count--) {
+		Serial.write((const uint8_t *)&TRACE_RING[pos], sizeof(trace_rec_t));
+		if (++pos >= PINTRACE)
+			pos = 0;
+	}
+}
+#endif
@@ -0,0 +1,67 @@
+#ifndef	__PINTRACE_H_
+#define	__PINTRACE_H_
+
+//	PinTrace.h
+//	This sketch licensed under the MIT License (MIT)
+//	Copyright (c) 2015 hieromon@gmail.com
+//
+//	Optional trace recorder of the programming signals for the timing
+//	analysis of FuseRescue and ArduinoISP. The events are stamped by
+//	micros() and kept in a ring buffer, the dump is converted to VCD and
+//	the time of each phase by tools/tracevcd.py.
+//	Define PINTRACE as the number of the events that the ring buffer holds
+//	to enable it. Without PINTRACE the TRACE macros are empty and nothing
+//	is compiled in.
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+//#define	PINTRACE	128
+
+// Event kinds, each event has a byte of value
+#define	TRACE_GAP		0					// Time stamp wrapped, value is the number of 65536us
+#define	TRACE_BEGIN		1					// Phase begins, value is TRACE_PHASE_xxx
+#define	TRACE_END		2					// Phase ends, value is TRACE_PHASE_xxx
+#define	TRACE_LINE		3					// Control line edge, value is TRACE_xxx << 1 | level
+#define	TRACE_SELECT	4					// XA1, XA0, BS1 and BS2 at a strobe, value is XA1 << 3 | XA0 << 2 | BS1 << 1 | BS2
+#define	TRACE_BUS_OUT	5					// Byte driven to the data bus
+#define	TRACE_BUS_IN	6					// Byte sampled from the data bus
+#define	TRACE_SPI_OUT	7					// Instruction byte of a SPI transaction begins
+#define	TRACE_SPI_IN	8					// Last byte received ends the SPI transaction
+
+// Control lines
+#define	TRACE_VCC		0
+#define	TRACE_HV		1					// +12V on #RESET
+#define	TRACE_XTAL1		2
+#define	TRACE_WR		3
+#define	TRACE_OE		4
+#define	TRACE_PAGEL		5
+#define	TRACE_RDY		6					// RDY/#BSY
+#define	TRACE_RESET		7					// #RESET of ArduinoISP
+
+// Phases
+#define	TRACE_PHASE_START		0			// Entering the parallel programming
+#define	TRACE_PHASE_BUSY		1			// Waiting for RDY/#BSY
+#define	TRACE_PHASE_WAIT		2			// Waiting for the ready of ArduinoISP target
+#define	TRACE_PHASE_PMODE		3			// Entering the serial programming
+
+// Head of the dump, the record count in little endian and the records of
+// 4 bytes, the lower 16 bits of micros() in little endian, kind and value.
+#define	TRACE_MAGIC		"\x7fTR"
+
+#ifdef PINTRACE
+namespace PinTrace {
+	void	record(uint8_t kind, uint8_t value);	// Add an event
+	void	dump(void);							// Send the events by Serial and clear them
+}
+#define	TRACE(kind, value)		PinTrace::record(kind, value)
+#define	TRACE_LEVEL(line, level)	PinTrace::record(TRACE_LINE, (line) << 1 | ((level) ? 1 : 0))
+#else
+#define	TRACE(kind, value)		((void)0)
+#define	TRACE_LEVEL(line, level)	((void)0)
+#endif
+
+#endif	/* __PINTRACE_H_ */
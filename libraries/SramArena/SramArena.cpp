@@ -0,0 +1,71 @@
+//	SramArena.cpp
+//	This sketch licensed under the MIT License (MIT)
+//	Copyright (c) 2015 hieromon@gmail.com
+//
+//	The arena is a bump allocator, the claims are never released because
+//	the mode lasts until the next reset.
+//	The high-water mark is taken by painting the gap between the heap and
+//	the stack with a canary, the peak usage is the extent that the canary
+//	has been overwritten.
+
+#include "SramArena.h"
+
+#define	SRAM_CANARY		0xC5			// Paint pattern of the unused SRAM
+#define	SRAM_MARGIN		16				// Stack frame of paint() itself, not painted
+
+// Bounds of the heap from avr-libc
+extern uint8_t	__heap_start;
+extern void		*__brkval;
+
+static uint8_t	ARENA[SRAM_ARENA_SIZE];
+static size_t	ARENA_USED;
+
+/**
+ * Allocate the memory from the arena.
+ * @param	size	Bytes to be allocated
+ * @return	Pointer to the allocated memory, NULL if the arena has not enough room
+ */
+void *SramArena::claim(size_t size) {
+	if (size > SRAM_ARENA_SIZE - ARENA_USED)
+		return NULL;
+	ARENA_USED += size;
+	return &ARENA[ARENA_USED - size];
+}
+
+/**
+ * Bytes of the arena which remain to be claimed
+ */
+size_t SramArena::remain(void) {
+	return SRAM_ARENA_SIZE - ARENA_USED;
+}
+
+// Lowest address of the gap between the heap and the stack
+static uint8_t *heap_end(void) {
+	return __brkval ? (uint8_t *)__brkval : &__heap_start;
+}
+
+/**
+ * Paint the gap between the heap and the stack by the canary.
+ * It should be called at the beginning of setup() while the stack is shallow.
+ */
+void SramArena::paint(void) {
+	uint8_t	*p = heap_end();
+	uint8_t	*sp = (uint8_t *)SP - SRAM_MARGIN;
+
+	while (p < sp)
+		*p++ = SRAM_CANARY;
+}
+
+/**
+ * Measure the peak SRAM usage, that is the whole SRAM except the part of
+ * the gap which the stack has never reached.
+ * @return	Peak usage of SRAM in bytes
+ */
+size_t SramArena::high_water(void) {
+	uint8_t	*p = heap_end();
+	size_t	untouched = 0;
+
+	while (*p++ == SRAM_CANARY)
+		untouched++;
+	return (RAMEND + 1 - RAMSTART) - untouched;
+}
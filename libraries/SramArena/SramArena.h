@@ -0,0 +1,32 @@
+#ifndef	__SRAMARENA_H_
+#define	__SRAMARENA_H_
+
+//	SramArena.h
+//	This sketch licensed under the MIT License (MIT)
+//	Copyright (c) 2015 hieromon@gmail.com
+//
+//	Only one of FuseRescue and ArduinoISP runs per boot, so their large
+//	buffers share one static arena instead of being resident both.
+//	The running mode claims its buffers at setup().
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+// Size of the arena, it covers the largest of the claims by each mode.
+// ArduinoISP:	256 (buff)
+// FuseRescue:	256 (request and response frame, Flash page)
+#ifndef SRAM_ARENA_SIZE
+#define SRAM_ARENA_SIZE		256
+#endif
+
+namespace SramArena {
+	void	*claim(size_t size);				// Allocate from the arena, NULL if it ran out
+	size_t	remain(void);						// Bytes not claimed yet
+	void	paint(void);						// Mark the unused SRAM for high_water()
+	size_t	high_water(void);					// Peak SRAM usage in bytes since paint()
+}
+
+#endif	/* __SRAMARENA_H_ */
@@ -0,0 +1,44 @@
+#!/bin/sh
+#	avrsize.sh
+#	This sketch licensed under the MIT License (MIT)
+#	Copyright (c) 2015 hieromon@gmail.com
+#
+#	Builds the sketch for the Uno at each git revision by arduino-cli and
+#	prints the Flash and the static SRAM from avr-size, so that a change is
+#	compared before and after. Flash is text + data, SRAM is data + bss,
+#	the stack and the arena high-water mark are not included.
+#	MsTimer2 has to be installed in the Arduino libraries. AVR_SIZE gives
+#	avr-size if it is not on the PATH, arduino-cli keeps one under
+#	~/.arduino15/packages/arduino/tools/avr-gcc.
+#
+#	usage: tools/avrsize.sh REV [REV...]
+#	e.g.   tools/avrsize.sh e8f40d8^ e8f40d8
+
+[ $# -ge 1 ] || { echo "usage: $0 REV [REV...]" >&2; exit 2; }
+AVR_SIZE=${AVR_SIZE:-avr-size}
+command -v arduino-cli > /dev/null || { echo "$0: arduino-cli is not found" >&2; exit 1; }
+command -v "$AVR_SIZE" > /dev/null || { echo "$0: $AVR_SIZE is not found, set AVR_SIZE" >&2; exit 1; }
+WORK=$(mktemp -d)
+trap 'git worktree remove --force "$WORK/ISPFuseRescue" 2> /dev/null; rm -rf "$WORK"' EXIT
+
+printf '%-12s %8s %8s\n' rev flash sram
+status=0
+for rev in "$@"; do
+	# The sketch folder has to be named after the .ino
+	git worktree remove --force "$WORK/ISPFuseRescue" 2> /dev/null
+	rm -rf "$WORK/out"
+	git worktree add -q --detach "$WORK/ISPFuseRescue" "$rev" || { status=1; continue; }
+	LIBS=
+	for lib in "$WORK"/ISPFuseRescue/libraries/*/; do
+		LIBS="$LIBS --library $lib"
+	done
+	if ! arduino-cli compile -b arduino:avr:uno --output-dir "$WORK/out" $LIBS \
+		"$WORK/ISPFuseRescue" > "$WORK/log" 2>&1; then
+		cat "$WORK/log" >&2
+		status=1
+		continue
+	fi
+	"$AVR_SIZE" "$WORK/out/ISPFuseRescue.ino.elf" | awk -v rev="$rev" \
+		'NR == 2 { printf "%-12s %8d %8d\n", rev, $1 + $2, $2 + $3 }'
+done
+exit $status
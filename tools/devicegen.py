@@ -0,0 +1,194 @@
+#!/usr/bin/env python3
+#	devicegen.py
+#	This sketch licensed under the MIT License (MIT)
+#	Copyright (c) 2015 hieromon@gmail.com
+#
+#	Generate the compact device table libraries/FuseRescue/devicetab.h from
+#	the part description tools/devices.txt.
+#	- The family prefix and the rest of the chip name are pooled separately,
+#	  a name which is a tail of another name shares its bytes.
+#	- The Fuse byte triples and the memory geometries are shared records.
+#	- The entries are placed by a minimal perfect hash of the signature in
+#	  the hash and displace manner, so that the lookup takes two hash
+#	  calculations however many parts are listed. The hash is the same as
+#	  device_hash() in devicesig.h.
+#
+#	usage: devicegen.py [--check]
+#	--check does not write, it fails if devicetab.h is not up to date.
+
+import os
+import re
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SOURCE = os.path.join(HERE, 'devices.txt')
+TARGET = os.path.join(HERE, '..', 'libraries', 'FuseRescue', 'devicetab.h')
+
+DEVICE_VENDOR = 0x1E		# Manufacturer code of the signature
+UNKNOWN_DEVICE = 0xFF		# DEVICE_ID which indicates no device
+MAX_DISP = 255				# Displacement is stored by a byte
+
+
+def device_hash(sig, seed):
+	"""FNV-1a over the signature bytes, the seed perturbs the basis"""
+	h = 2166136261 ^ seed
+	for b in ((sig >> 16) & 0xFF, (sig >> 8) & 0xFF, sig & 0xFF):
+		h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+	return h
+
+
+def parse(path):
+	parts = []
+	with open(path) as f:
+		for n, line in enumerate(f, 1):
+			line = line.split('#', 1)[0].strip()
+			if not line:
+				continue
+			col = line.split()
+			if len(col) != 8:
+				sys.exit('%s:%d: 8 columns are required' % (path, n))
+			name, sig, eeprom, flash, page, timing, default, bt = col
+			fuse = [tuple(int(x, 16) for x in v.split(',')) for v in (default, bt)]
+			if any(len(v) != 3 for v in fuse):
+				sys.exit('%s:%d: Fuse bytes are low,high,ext' % (path, n))
+			parts.append({
+				'name': name, 'sig': int(sig, 16),
+				'eeprom': int(eeprom), 'flash': int(flash), 'page': int(page),
+				'timing': timing, 'fuse': fuse[0], 'bt_fuse': fuse[1]})
+	sigs = [p['sig'] for p in parts]
+	if len(set(sigs)) != len(sigs):
+		sys.exit('%s: a signature is listed twice' % path)
+	if any(s >> 16 != DEVICE_VENDOR for s in sigs):
+		sys.exit('%s: the signature must start with %02X' % (path, DEVICE_VENDOR))
+	if len(parts) >= UNKNOWN_DEVICE:
+		sys.exit('%s: too many parts for DEVICE_ID' % path)
+	return parts
+
+
+def perfect_hash(sigs):
+	"""Find the bucket count and the displacement of each bucket"""
+	n = len(sigs)
+	for buckets in range(max(1, (n + 1) // 2), n + 1):
+		bucket = [[] for _ in range(buckets)]
+		for s in sigs:
+			bucket[device_hash(s, 0) % buckets].append(s)
+		disp = [0] * buckets
+		used = {}
+		order = sorted(range(buckets), key=lambda b: -len(bucket[b]))
+		for b in order:
+			if not bucket[b]:
+				continue
+			for d in range(1, MAX_DISP + 1):
+				slots = [device_hash(s, d) % n for s in bucket[b]]
+				if len(set(slots)) == len(slots) and not any(x in used for x in slots):
+					disp[b] = d
+					for s, x in zip(bucket[b], slots):
+						used[x] = s
+					break
+			else:
+				break
+		else:
+			return buckets, disp, used
+	sys.exit('perfect hash is not found')
+
+
+def pool(strings):
+	"""Pool NUL terminated strings, a string which is a tail of another one shares it"""
+	text = ''
+	offset = {}
+	for s in sorted(set(strings), key=lambda s: (-len(s), s)):
+		at = text.find(s + '\0')
+		if at < 0:
+			at = len(text)
+			text += s + '\0'
+		offset[s] = at
+	return text, offset
+
+
+def records(values):
+	"""Deduplicate the records in order of appearance"""
+	index = {}
+	for v in values:
+		index.setdefault(v, len(index))
+	return sorted(index, key=index.get), index
+
+
+def c_string(text):
+	return ' '.join('"%s\\0"' % s for s in text.split('\0')[:-1])
+
+
+def generate(parts):
+	split = [re.match(r'([A-Za-z]+)(.*)$', p['name']).groups() for p in parts]
+	prefix_text, prefix_at = pool(s[0] for s in split)
+	name_text, name_at = pool(s[1] for s in split)
+	if len(prefix_text) > 0xFF or len(name_text) > 0xFFFF:
+		sys.exit('names are too long')
+	fuses, fuse_at = records([p['fuse'] for p in parts] + [p['bt_fuse'] for p in parts])
+	mems, mem_at = records((p['eeprom'], p['flash'], p['page'], p['timing']) for p in parts)
+	buckets, disp, slot = perfect_hash([p['sig'] for p in parts])
+	by_sig = {p['sig']: (p, s) for p, s in zip(parts, split)}
+	page_bytes = max(p['page'] for p in parts) * 2
+
+	out = []
+	w = out.append
+	w('#ifndef\t__DEVICETAB_H__')
+	w('#define\t__DEVICETAB_H__')
+	w('')
+	w('//\tdevicetab.h')
+	w('//\tThis sketch licensed under the MIT License (MIT)')
+	w('//\tCopyright (c) 2015 hieromon@gmail.com')
+	w('//\tGenerated by tools/devicegen.py from tools/devices.txt, do not edit.')
+	w('')
+	w('#define\tDEVICE_COUNT\t%d' % len(parts))
+	w('#define\tDEVICE_BUCKETS\t%d' % buckets)
+	w('// The largest Flash page in bytes among the devices')
+	w('#define\tMAX_PAGE_BYTES\t%d' % page_bytes)
+	w('')
+	w('// Chip name is the family prefix followed by the rest of the name')
+	w('const char\tDEVICE_PREFIXES[] PROGMEM = %s;' % c_string(prefix_text))
+	w('const char\tDEVICE_NAMES[] PROGMEM = %s;' % c_string(name_text))
+	w('// Fuse bytes of low, high and ext')
+	w('const uint8_t\tDEVICE_FUSES[][3] PROGMEM = {')
+	w(',\n'.join('\t{0x%02X, 0x%02X, 0x%02X}' % f for f in fuses))
+	w('};')
+	w('const device_mem_t\tDEVICE_MEMORY[] PROGMEM = {')
+	w(',\n'.join('\t{%5d, %5d, %3d, PGM_TIMING_%s}' % m for m in mems))
+	w('};')
+	w('// Displacement of each bucket of the perfect hash')
+	w('const uint8_t\tDEVICE_DISP[DEVICE_BUCKETS] PROGMEM = { %s };' % ', '.join(str(d) for d in disp))
+	w('// Each entry is placed at the slot of its signature')
+	w('const device_rec_t\tDEVICE_LIST[DEVICE_COUNT] PROGMEM = {')
+	rows = []
+	for x in range(len(parts)):
+		p, s = by_sig[slot[x]]
+		rows.append('\t{0x%04X, %3d, %2d, %2d, %2d, %2d}' % (
+			p['sig'] & 0xFFFF, name_at[s[1]], prefix_at[s[0]],
+			mem_at[(p['eeprom'], p['flash'], p['page'], p['timing'])],
+			fuse_at[p['fuse']], fuse_at[p['bt_fuse']]))
+	for x, r in enumerate(rows):
+		w('%s%s\t// %s' % (r, ',' if x < len(rows) - 1 else ' ', by_sig[slot[x]][0]['name']))
+	w('};')
+	w('// The hash of devicesig.h reaches the same slots')
+	for x in range(len(parts)):
+		p = by_sig[slot[x]][0]
+		b = device_hash(p['sig'], 0) % buckets
+		w('static_assert(device_hash(0x%06X, 0) %% DEVICE_BUCKETS == %d && device_hash(0x%06X, %d) %% DEVICE_COUNT == %d, "%s");' % (
+			p['sig'], b, p['sig'], disp[b], x, p['name']))
+	w('')
+	w('#endif\t/* __DEVICETAB_H__ */')
+	return '\n'.join(out) + '\n'
+
+
+def main():
+	text = generate(parse(SOURCE))
+	if '--check' in sys.argv[1:]:
+		with open(TARGET) as f:
+			if f.read() != text:
+				sys.exit('devicetab.h is not up to date, run devicegen.py')
+		return
+	with open(TARGET, 'w', newline='\n') as f:
+		f.write(text)
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,70 @@
+#ifndef	Arduino_h
+#define	Arduino_h
+
+//	Arduino.h
+//	This sketch licensed under the MIT License (MIT)
+//	Copyright (c) 2015 hieromon@gmail.com
+//
+//	Fake Arduino core of the host simulation, the declarations which the
+//	libraries of the sketch use. They are implemented by core.cpp.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+#include "binary.h"
+
+#define	HIGH			1
+#define	LOW				0
+#define	INPUT			0
+#define	OUTPUT			1
+#define	INPUT_PULLUP	2
+
+typedef bool	boolean;
+typedef uint8_t	byte;
+
+#define	lowByte(w)		((uint8_t)((w) & 0xff))
+#define	highByte(w)		((uint8_t)((w) >> 8))
+
+void	pinMode(uint8_t pin, uint8_t mode);
+void	digitalWrite(uint8_t pin, uint8_t val);
+int		digitalRead(uint8_t pin);
+void	analogWrite(uint8_t pin, int val);
+void	delay(unsigned long ms);
+void	delayMicroseconds(unsigned int us);
+unsigned long	millis(void);
+unsigned long	micros(void);
+
+// The serial port with the members of Print and Stream in use
+class HardwareSerial {
+public:
+	void	begin(unsigned long baud);
+	void	end(void);
+	int		available(void);
+	int		peek(void);
+	int		read(void);
+	int		availableForWrite(void);
+	void	flush(void);
+	size_t	write(uint8_t c);
+	size_t	write(const uint8_t *buffer, size_t size);
+	size_t	write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+	size_t	write(int c) { return write((uint8_t)c); }
+	size_t	print(const char *str) { return write(str); }
+	size_t	print(char c) { return write((uint8_t)c); }
+	size_t	print(unsigned char n, int base = 10) { return print((unsigned long)n, base); }
+	size_t	print(int n, int base = 10) { return print((long)n, base); }
+	size_t	print(unsigned int n, int base = 10) { return print((unsigned long)n, base); }
+	size_t	print(long n, int base = 10);
+	size_t	print(unsigned long n, int base = 10);
+	size_t	println(void) { return write("\r\n"); }
+	size_t	println(const char *str) { return print(str) + println(); }
+	operator bool() { return true; }
+};
+extern HardwareSerial	Serial;
+
+#include "pins_arduino.h"
+
+#endif	/* Arduino_h */
@@ -0,0 +1,14 @@
+#ifndef	MsTimer2_h
+#define	MsTimer2_h
+
+//	MsTimer2.h
+//	The Timer2 library of the host simulation, the function is called
+//	as an interrupt at each period on the simulated clock.
+
+namespace MsTimer2 {
+	void	set(unsigned long ms, void (*f)());
+	void	start(void);
+	void	stop(void);
+}
+
+#endif	/* MsTimer2_h */
@@ -0,0 +1,13 @@
+#ifndef	_AVR_INTERRUPT_H_
+#define	_AVR_INTERRUPT_H_
+
+//	avr/interrupt.h
+//	The I flag lives in SREG, a pending interrupt is taken when the
+//	simulated time advances with the flag set.
+
+#define	ISR(vector, ...)	extern "C" void vector(void)
+
+void	cli(void);
+void	sei(void);
+
+#endif	/* _AVR_INTERRUPT_H_ */
@@ -0,0 +1,64 @@
+#ifndef	_AVR_IO_H_
+#define	_AVR_IO_H_
+
+//	avr/io.h
+//	I/O registers of the ATmega328P which the sketch uses. They are kept
+//	at the data space address in a page which core.cpp write protects, so
+//	that each store reaches the models. SREG is an ordinary variable.
+
+#include <stdint.h>
+
+#ifndef	F_CPU
+#define	F_CPU		16000000UL
+#endif
+
+extern uint8_t	*hostsim_io;
+extern volatile uint8_t	hostsim_sreg;
+#define	_SFR_MEM8(addr)		(*(volatile uint8_t *)(hostsim_io + (addr)))
+#define	_SFR_MEM16(addr)	(*(volatile uint16_t *)(hostsim_io + (addr)))
+
+#define	PINB		_SFR_MEM8(0x23)
+#define	DDRB		_SFR_MEM8(0x24)
+#define	PORTB		_SFR_MEM8(0x25)
+#define	PINC		_SFR_MEM8(0x26)
+#define	DDRC		_SFR_MEM8(0x27)
+#define	PORTC		_SFR_MEM8(0x28)
+#define	PIND		_SFR_MEM8(0x29)
+#define	DDRD		_SFR_MEM8(0x2A)
+#define	PORTD		_SFR_MEM8(0x2B)
+#define	PCIFR		_SFR_MEM8(0x3B)
+#define	SPCR		_SFR_MEM8(0x4C)
+#define	SPSR		_SFR_MEM8(0x4D)
+#define	SPDR		_SFR_MEM8(0x4E)
+#define	PCICR		_SFR_MEM8(0x68)
+#define	PCMSK0		_SFR_MEM8(0x6B)
+#define	TCCR1A		_SFR_MEM8(0x80)
+#define	TCCR1B		_SFR_MEM8(0x81)
+#define	TCNT1		_SFR_MEM16(0x84)
+#define	SREG		hostsim_sreg
+
+#define	SPIF		7
+#define	SPI2X		0
+#define	SPE			6
+#define	MSTR		4
+#define	SPR1		1
+#define	SPR0		0
+#define	PCIE0		0
+#define	PCIF0		0
+#define	CS12		2
+#define	CS11		1
+#define	CS10		0
+
+// The heap and the stack of SramArena are a buffer of core.cpp
+#define	RAMSTART	0x100
+#define	RAMEND		0x8FF
+extern uint8_t	*hostsim_heap;
+extern void		*hostsim_brkval;
+extern uint8_t	*hostsim_sp;
+#define	__heap_start	(*hostsim_heap)
+#define	__brkval		hostsim_brkval
+#define	SP				((uintptr_t)hostsim_sp)
+
+#define	_BV(bit)	(1 << (bit))
+
+#endif	/* _AVR_IO_H_ */
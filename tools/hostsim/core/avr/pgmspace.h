@@ -0,0 +1,20 @@
+#ifndef	__PGMSPACE_H_
+#define	__PGMSPACE_H_
+
+//	avr/pgmspace.h
+//	The program space is the ordinary memory on the host.
+
+#include <stdint.h>
+#include <string.h>
+
+#define	PROGMEM
+#define	PSTR(s)				(s)
+#define	pgm_read_byte(p)	(*(const uint8_t *)(p))
+#define	pgm_read_word(p)	(*(const uint16_t *)(p))
+#define	pgm_read_dword(p)	(*(const uint32_t *)(p))
+#define	pgm_read_ptr(p)		(*(void * const *)(p))
+#define	memcpy_P			memcpy
+#define	strlen_P			strlen
+typedef const char	*PGM_P;
+
+#endif	/* __PGMSPACE_H_ */
@@ -0,0 +1,15 @@
+#ifndef	_AVR_SLEEP_H_
+#define	_AVR_SLEEP_H_
+
+//	avr/sleep.h
+//	The sleep advances the simulated time to the next interrupt.
+
+#define	SLEEP_MODE_IDLE		0
+
+void	set_sleep_mode(uint8_t mode);
+void	sleep_enable(void);
+void	sleep_disable(void);
+void	sleep_cpu(void);
+void	sleep_mode(void);
+
+#endif	/* _AVR_SLEEP_H_ */
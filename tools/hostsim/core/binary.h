@@ -0,0 +1,17 @@
+#ifndef	Binary_h
+#define	Binary_h
+
+//	binary.h
+//	The binary constants which the libraries of the sketch use.
+
+#define	B00000000	0
+#define	B00000010	2
+#define	B00000011	3
+#define	B00000100	4
+#define	B00001000	8
+#define	B00010000	16
+#define	B00100000	32
+#define	B01000000	64
+#define	B10000000	128
+
+#endif	/* Binary_h */
@@ -0,0 +1,750 @@
+//	core.cpp
+//	This sketch licensed under the MIT License (MIT)
+//	Copyright (c) 2015 hieromon@gmail.com
+//
+//	Fake Arduino core of the host simulation.
+//	The I/O registers are a page which is mapped read-only. A store of the
+//	sketch faults, the page is opened and the store is single stepped by
+//	the trap flag, then the register is handled and the page is closed
+//	again. This needs Linux on x86-64. The pins, SPI, Timer1, the pin
+//	change interrupt, MsTimer2 and the serial port are modelled on the
+//	simulated clock of hostsim.h.
+
+#include "Arduino.h"
+#include "MsTimer2.h"
+#include <avr/sleep.h>
+#include "hostsim.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <ucontext.h>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#if !defined(__linux__) || !defined(__x86_64__)
+#error "hostsim traps the register stores with the trap flag of x86-64 Linux"
+#endif
+
+#define	IO_PAGE			4096
+#define	POLL_NS			1000ULL			// Cost of a polling call of the core
+#define	TIMER0_NS		1024000ULL		// Timer0 overflow of millis(), it wakes the sleep
+#define	SERIAL_BUFFER	64				// Ring size of HardwareSerial
+
+uint8_t	*hostsim_io;
+volatile uint8_t	hostsim_sreg;
+static uint8_t	SRAM[RAMEND + 1 - RAMSTART];
+uint8_t	*hostsim_heap = SRAM;
+void	*hostsim_brkval;
+uint8_t	*hostsim_sp = SRAM + sizeof SRAM;
+HardwareSerial	Serial;
+
+extern "C" void PCINT0_vect(void) __attribute__((weak));
+
+namespace {
+
+// Simulated clock and the events of the models
+uint64_t	CLOCK;
+std::multimap<uint64_t, std::function<void()>>	EVENTS;
+hostsim::Target	*TARGET;
+hostsim::Counters	COUNTERS;
+std::vector<std::string>	VIOLATIONS;
+
+// The page is opened while a trapped store is handled
+bool		IO_OPEN;
+uintptr_t	TRAP_ADDR;
+
+// Pins of the Uno, the registers of PORTB, PORTC and PORTD
+struct PortRegs {
+	uint8_t	pin, ddr, port;
+};
+const PortRegs	PORT_REGS[] = { { 0x23, 0x24, 0x25 }, { 0x26, 0x27, 0x28 }, { 0x29, 0x2A, 0x2B } };
+const PortRegs &pin_port(int pin) {
+	return PORT_REGS[pin < 8 ? 2 : (pin < 14 ? 0 : 1)];
+}
+uint8_t pin_mask(int pin) {
+	return 1 << (pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14));
+}
+int8_t	UNO_LEVEL[hostsim::PINS];			// Driven by the Uno or Z
+int8_t	TARGET_LEVEL[hostsim::PINS];		// Driven by the target or Z
+bool	CONTENDED[hostsim::PINS];
+
+// Timer1 counts from the base at the prescaler
+uint64_t	T1_BASE;
+uint16_t	T1_COUNT;
+
+// MsTimer2
+unsigned long	MT2_MS;
+void		(*MT2_FUNC)();
+unsigned	MT2_GEN;
+bool		MT2_PENDING;
+
+// Serial port
+uint32_t	BAUD;
+double		ACTUAL_BAUD;
+uint64_t	BYTE_NS, HOST_BYTE_NS;
+std::deque<std::pair<uint64_t, uint8_t>>	RX_PENDING;
+std::deque<uint8_t>	RX_RING;
+uint64_t	HOST_FREE;						// The host line is free from this time
+std::deque<uint64_t>	TX_END;				// Bytes on the way out of the UART
+uint64_t	TX_LAST;
+std::string	RECEIVED;
+std::vector<uint64_t>	WRITTEN_AT;			// Time when the sketch has put each byte
+bool		EXPECT;
+std::string	EXPECT_TEXT;
+size_t		EXPECT_FROM;
+uint64_t	QUIET_NS = 2000000000ULL;
+uint64_t	ACTIVITY;						// Last byte on the line
+uint32_t	OVERRUNS;
+int			PTY = -1;
+bool		PTY_PEER;						// The host has opened the pty and sent
+
+// The sketch runs on its own context
+#define	SKETCH_STACK	(1 << 20)
+ucontext_t	HOST_CONTEXT, SKETCH_CONTEXT;
+void		(*SKETCH_SETUP)(void), (*SKETCH_LOOP)(void);
+bool		DEADLOCK;
+
+void sketch_main(void) {
+	SKETCH_SETUP();
+	for (;;)
+		SKETCH_LOOP();
+}
+
+// Return to the host until run() resumes the sketch
+void yield_host(void) {
+	swapcontext(&SKETCH_CONTEXT, &HOST_CONTEXT);
+}
+
+uint8_t io_get(unsigned addr) {
+	return hostsim_io[addr];
+}
+
+// Store into a register from the core, the page is opened if it is closed
+void io_set(unsigned addr, uint8_t value) {
+	if (IO_OPEN) {
+		hostsim_io[addr] = value;
+		return;
+	}
+	mprotect(hostsim_io, IO_PAGE, PROT_READ | PROT_WRITE);
+	hostsim_io[addr] = value;
+	mprotect(hostsim_io, IO_PAGE, PROT_READ);
+}
+
+void update_timer1(void) {
+	static const uint32_t	prescale[] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+	uint32_t	div = prescale[io_get(0x81) & 0x07];
+	uint16_t	count = T1_COUNT;
+
+	if (div)
+		count += (uint16_t)((CLOCK - T1_BASE) * (F_CPU / 1000000) / 1000 / div);
+	if (IO_OPEN || count != *(uint16_t *)(hostsim_io + 0x84)) {
+		io_set(0x84, (uint8_t)count);
+		io_set(0x85, (uint8_t)(count >> 8));
+	}
+}
+
+void rebase_timer1(void) {
+	update_timer1();
+	T1_COUNT = *(uint16_t *)(hostsim_io + 0x84);
+	T1_BASE = CLOCK;
+}
+
+// Resolve the level of each pin and the PIN registers from both sides
+void update_pins(bool notify) {
+	int8_t	before[hostsim::PINS];
+	uint8_t	pinb = io_get(0x23);
+
+	memcpy(before, UNO_LEVEL, sizeof before);
+	for (int p = 0; p < hostsim::PINS; p++) {
+		const PortRegs	&r = pin_port(p);
+		uint8_t	m = pin_mask(p);
+		UNO_LEVEL[p] = io_get(r.ddr) & m ? (io_get(r.port) & m ? 1 : 0) : hostsim::Z;
+	}
+	// SCK idles low while SPI is the master
+	if ((io_get(0x4C) & (_BV(SPE) | _BV(MSTR))) == (_BV(SPE) | _BV(MSTR)) && UNO_LEVEL[SCK] != hostsim::Z)
+		UNO_LEVEL[SCK] = 0;
+	if (notify && TARGET && memcmp(before, UNO_LEVEL, sizeof before))
+		TARGET->pins(UNO_LEVEL);
+
+	uint8_t	pins[3] = { 0, 0, 0 };
+	for (int p = 0; p < hostsim::PINS; p++) {
+		const PortRegs	&r = pin_port(p);
+		uint8_t	m = pin_mask(p);
+		int8_t	level = UNO_LEVEL[p];
+		bool	pullup = !(io_get(r.ddr) & m) && (io_get(r.port) & m);
+		CONTENDED[p] = level != hostsim::Z && TARGET_LEVEL[p] != hostsim::Z && level != TARGET_LEVEL[p];
+		if (level == hostsim::Z)
+			level = TARGET_LEVEL[p] != hostsim::Z ? TARGET_LEVEL[p] : (pullup ? 1 : 0);
+		uint8_t	*reg = &pins[&r - PORT_REGS];
+		if (level)
+			*reg |= m;
+		if (!(io_get(r.pin) & m) != !level)
+			COUNTERS.toggles[p]++;
+	}
+	for (int i = 0; i < 3; i++)
+		if (io_get(PORT_REGS[i].pin) != pins[i])
+			io_set(PORT_REGS[i].pin, pins[i]);
+	// The pin change of PORTB raises the flag of PCINT0
+	if ((pinb ^ pins[0]) & io_get(0x6B))
+		io_set(0x3B, io_get(0x3B) | _BV(PCIF0));
+}
+
+// SPI transfer started by a store into SPDR
+void spi_transfer(uint8_t mosi) {
+	static const uint16_t	divider[] = { 4, 16, 64, 128 };
+	uint8_t		spcr = io_get(0x4C);
+	uint32_t	div = divider[spcr & 0x03] >> (io_get(0x4D) & _BV(SPI2X) ? 1 : 0);
+	uint8_t		miso = 0xFF;
+
+	if ((spcr & (_BV(SPE) | _BV(MSTR))) != (_BV(SPE) | _BV(MSTR)))
+		return;
+	if (TARGET)
+		miso = TARGET->spi(mosi, F_CPU / div);
+	// The clock moves without the events, they are taken at the next
+	// polling of the sketch as the transfer is shorter than any of them
+	CLOCK += 8ULL * div * 1000000000ULL / F_CPU;
+	COUNTERS.spi_bytes++;
+	io_set(0x4E, miso);
+	io_set(0x4D, io_get(0x4D) | _BV(SPIF));
+}
+
+// A store of the sketch has reached the register
+void io_written(unsigned addr, uint8_t old) {
+	uint8_t	value = io_get(addr);
+
+	COUNTERS.io_writes++;
+	switch (addr) {
+	case 0x23: case 0x26: case 0x29:
+		// Writing one to PINx toggles PORTx
+		io_set(addr + 2, io_get(addr + 2) ^ value);
+		io_set(addr, old);
+		update_pins(true);
+		break;
+	case 0x24: case 0x25: case 0x27: case 0x28: case 0x2A: case 0x2B:
+	case 0x4C:
+		update_pins(true);
+		break;
+	case 0x3B:
+		// Writing one clears the flag
+		io_set(addr, old & ~value);
+		break;
+	case 0x4D:
+		// SPIF is read only
+		io_set(addr, (old & _BV(SPIF)) | (value & _BV(SPI2X)));
+		break;
+	case 0x4E:
+		spi_transfer(value);
+		break;
+	case 0x81:
+		io_set(addr, old);
+		rebase_timer1();
+		io_set(addr, value);
+		break;
+	case 0x84: case 0x85:
+		T1_COUNT = *(uint16_t *)(hostsim_io + 0x84);
+		T1_BASE = CLOCK;
+		break;
+	}
+}
+
+uint8_t	TRAP_OLD;
+
+void on_segv(int sig, siginfo_t *si, void *context) {
+	uint8_t	*addr = (uint8_t *)si->si_addr;
+
+	if (!hostsim_io || addr < hostsim_io || addr >= hostsim_io + IO_PAGE || IO_OPEN) {
+		// Not a register, let it crash
+		signal(sig, SIG_DFL);
+		return;
+	}
+	TRAP_ADDR = addr - hostsim_io;
+	TRAP_OLD = *addr;
+	IO_OPEN = true;
+	mprotect(hostsim_io, IO_PAGE, PROT_READ | PROT_WRITE);
+	((ucontext_t *)context)->uc_mcontext.gregs[REG_EFL] |= 0x100;
+}
+
+void on_trap(int, siginfo_t *, void *context) {
+	((ucontext_t *)context)->uc_mcontext.gregs[REG_EFL] &= ~0x100;
+	io_written(TRAP_ADDR, TRAP_OLD);
+	IO_OPEN = false;
+	mprotect(hostsim_io, IO_PAGE, PROT_READ);
+}
+
+__attribute__((constructor)) void core_init(void) {
+	struct sigaction	sa;
+
+	hostsim_io = (uint8_t *)mmap(NULL, IO_PAGE, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	memset(&sa, 0, sizeof sa);
+	sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+	sa.sa_sigaction = on_segv;
+	sigaction(SIGSEGV, &sa, NULL);
+	sa.sa_sigaction = on_trap;
+	sigaction(SIGTRAP, &sa, NULL);
+	for (int p = 0; p < hostsim::PINS; p++)
+		UNO_LEVEL[p] = TARGET_LEVEL[p] = hostsim::Z;
+	hostsim_sreg = 0x80;
+}
+
+// Take the pending interrupts while the I flag is set
+void service(void) {
+	while (hostsim_sreg & 0x80) {
+		if ((io_get(0x3B) & _BV(PCIF0)) && (io_get(0x68) & _BV(PCIE0)) && PCINT0_vect) {
+			io_set(0x3B, io_get(0x3B) & ~_BV(PCIF0));
+			update_timer1();
+			hostsim_sreg &= ~0x80;
+			PCINT0_vect();
+			hostsim_sreg |= 0x80;
+		} else if (MT2_PENDING) {
+			MT2_PENDING = false;
+			hostsim_sreg &= ~0x80;
+			MT2_FUNC();
+			hostsim_sreg |= 0x80;
+		} else
+			break;
+	}
+}
+
+void check_contention(void) {
+	static bool	reported[hostsim::PINS];
+
+	for (int p = 0; p < hostsim::PINS; p++) {
+		if (CONTENDED[p] && !reported[p])
+			hostsim::violation("pin %d is driven by both the Uno and the target", p);
+		reported[p] = CONTENDED[p];
+	}
+}
+
+void mt2_schedule(unsigned gen, uint64_t at) {
+	hostsim::at(at, [gen, at]() {
+		if (gen != MT2_GEN)
+			return;
+		MT2_PENDING = true;
+		mt2_schedule(gen, at + MT2_MS * 1000000ULL);
+	});
+}
+
+// Serial port
+void rx_update(void) {
+	while (!RX_PENDING.empty() && RX_PENDING.front().first <= CLOCK) {
+		if (RX_RING.size() < SERIAL_BUFFER - 1)
+			RX_RING.push_back(RX_PENDING.front().second);
+		else
+			OVERRUNS++;
+		ACTIVITY = std::max(ACTIVITY, RX_PENDING.front().first);
+		RX_PENDING.pop_front();
+	}
+}
+
+void tx_update(void) {
+	while (!TX_END.empty() && TX_END.front() <= CLOCK)
+		TX_END.pop_front();
+}
+
+size_t tx_used(void) {
+	tx_update();
+	return TX_END.size() > 2 ? TX_END.size() - 2 : 0;
+}
+
+// The sketch polls the port which has nothing
+void rx_starved(void) {
+	if (PTY >= 0) {
+		struct pollfd	p = { PTY, POLLIN, 0 };
+		uint8_t	buf[256];
+		// With no bytes on the way, the simulated clock follows the real
+		// time while the sketch waits for the host
+		bool	idle = RX_PENDING.empty();
+		int		r = poll(&p, 1, idle ? 1 : 0);
+		if (r == 0 && idle)
+			hostsim::advance(1000000ULL);
+		else if (r > 0) {
+			ssize_t	n = read(PTY, buf, sizeof buf);
+			if (n > 0) {
+				PTY_PEER = true;
+				hostsim::send(buf, n);
+			} else if (PTY_PEER) {
+				// The host has closed the port, the script takes over
+				PTY_PEER = false;
+				yield_host();
+			} else
+				usleep(1000);
+		}
+		return;
+	}
+	if (!RX_PENDING.empty())
+		return;
+	tx_update();
+	if ((EXPECT && RECEIVED.find(EXPECT_TEXT, EXPECT_FROM) != std::string::npos && TX_END.empty()) ||
+		CLOCK > std::max(ACTIVITY, TX_LAST) + QUIET_NS) {
+		EXPECT = false;
+		ACTIVITY = CLOCK;
+		yield_host();
+	}
+}
+
+}	// namespace
+
+// Simulated clock
+uint64_t hostsim::now(void) {
+	return CLOCK;
+}
+
+void hostsim::advance(uint64_t ns) {
+	uint64_t	until = CLOCK + ns;
+
+	if (ns)
+		check_contention();
+	service();
+	while (!EVENTS.empty() && EVENTS.begin()->first <= until) {
+		auto	e = EVENTS.begin();
+		std::function<void()>	fn = e->second;
+		CLOCK = std::max(CLOCK, e->first);
+		EVENTS.erase(e);
+		fn();
+		service();
+	}
+	CLOCK = std::max(CLOCK, until);
+	service();
+}
+
+void hostsim::sketch(void (*setup)(void), void (*loop)(void)) {
+	SKETCH_SETUP = setup;
+	SKETCH_LOOP = loop;
+	getcontext(&SKETCH_CONTEXT);
+	SKETCH_CONTEXT.uc_stack.ss_sp = malloc(SKETCH_STACK);
+	SKETCH_CONTEXT.uc_stack.ss_size = SKETCH_STACK;
+	SKETCH_CONTEXT.uc_link = NULL;
+	makecontext(&SKETCH_CONTEXT, sketch_main, 0);
+}
+
+bool hostsim::run(void) {
+	if (!DEADLOCK)
+		swapcontext(&HOST_CONTEXT, &SKETCH_CONTEXT);
+	return !DEADLOCK;
+}
+
+void hostsim::at(uint64_t ns, std::function<void()> fn) {
+	EVENTS.emplace(ns, fn);
+}
+
+void hostsim::attach(Target *target) {
+	TARGET = target;
+	update_pins(true);
+}
+
+void hostsim::drive(int pin, int8_t level) {
+	if (TARGET_LEVEL[pin] == level)
+		return;
+	TARGET_LEVEL[pin] = level;
+	update_pins(false);
+}
+
+void hostsim::violation(const char *fmt, ...) {
+	char	msg[160];
+	int		n = snprintf(msg, sizeof msg, "%.1fus: ", CLOCK / 1000.0);
+	va_list	ap;
+
+	va_start(ap, fmt);
+	vsnprintf(msg + n, sizeof msg - n, fmt, ap);
+	va_end(ap);
+	VIOLATIONS.push_back(msg);
+}
+
+const std::vector<std::string> &hostsim::violations(void) {
+	return VIOLATIONS;
+}
+
+void hostsim::send(const void *data, size_t len) {
+	uint64_t	t = std::max(CLOCK, HOST_FREE);
+
+	for (size_t i = 0; i < len; i++) {
+		t += HOST_BYTE_NS;
+		RX_PENDING.push_back(std::make_pair(t, ((const uint8_t *)data)[i]));
+	}
+	HOST_FREE = t;
+}
+
+void hostsim::send(const std::string &s) {
+	send(s.data(), s.size());
+}
+
+const std::string &hostsim::received(void) {
+	return RECEIVED;
+}
+
+uint64_t hostsim::received_at(void) {
+	return TX_LAST;
+}
+
+uint64_t hostsim::written_at(size_t i) {
+	return WRITTEN_AT[i];
+}
+
+void hostsim::expect(const std::string &text) {
+	EXPECT = true;
+	EXPECT_TEXT = text;
+	EXPECT_FROM = RECEIVED.size();
+}
+
+void hostsim::quiet_limit(uint64_t ns) {
+	QUIET_NS = ns;
+}
+
+uint32_t hostsim::baud(void) {
+	return BAUD;
+}
+
+double hostsim::actual_baud(void) {
+	return ACTUAL_BAUD;
+}
+
+uint32_t hostsim::overruns(void) {
+	return OVERRUNS;
+}
+
+int hostsim::open_pty(std::string &path) {
+	struct termios	tio;
+
+	PTY = posix_openpt(O_RDWR | O_NOCTTY);
+	if (PTY < 0 || grantpt(PTY) < 0 || unlockpt(PTY) < 0)
+		return -1;
+	tcgetattr(PTY, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(PTY, TCSANOW, &tio);
+	path = ptsname(PTY);
+	return PTY;
+}
+
+hostsim::Counters &hostsim::counters(void) {
+	return COUNTERS;
+}
+
+uint64_t hostsim::toggles(void) {
+	uint64_t	sum = 0;
+
+	for (int p = 0; p < PINS; p++)
+		sum += COUNTERS.toggles[p];
+	return sum;
+}
+
+void hostsim::reset_counters(void) {
+	memset(&COUNTERS, 0, sizeof COUNTERS);
+}
+
+// Digital pins
+static void io_poke(unsigned addr, uint8_t value) {
+	uint8_t	old = io_get(addr);
+
+	mprotect(hostsim_io, IO_PAGE, PROT_READ | PROT_WRITE);
+	IO_OPEN = true;
+	hostsim_io[addr] = value;
+	io_written(addr, old);
+	IO_OPEN = false;
+	mprotect(hostsim_io, IO_PAGE, PROT_READ);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+	const PortRegs	&r = pin_port(pin);
+	uint8_t	m = pin_mask(pin);
+
+	if (mode == OUTPUT)
+		io_poke(r.ddr, io_get(r.ddr) | m);
+	else {
+		io_poke(r.ddr, io_get(r.ddr) & ~m);
+		io_poke(r.port, mode == INPUT_PULLUP ? io_get(r.port) | m : io_get(r.port) & ~m);
+	}
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+	const PortRegs	&r = pin_port(pin);
+	uint8_t	m = pin_mask(pin);
+
+	COUNTERS.digital_writes++;
+	io_poke(r.port, val ? io_get(r.port) | m : io_get(r.port) & ~m);
+}
+
+int digitalRead(uint8_t pin) {
+	return io_get(pin_port(pin).pin) & pin_mask(pin) ? HIGH : LOW;
+}
+
+// PWM is not modelled, the pin is high from the half duty
+void analogWrite(uint8_t pin, int val) {
+	pinMode(pin, OUTPUT);
+	digitalWrite(pin, val >= 128 ? HIGH : LOW);
+}
+
+// Time
+void delay(unsigned long ms) {
+	hostsim::advance(ms * 1000000ULL);
+}
+
+void delayMicroseconds(unsigned int us) {
+	hostsim::advance(us * 1000ULL);
+}
+
+unsigned long millis(void) {
+	hostsim::advance(POLL_NS);
+	return (unsigned long)(CLOCK / 1000000ULL);
+}
+
+unsigned long micros(void) {
+	hostsim::advance(POLL_NS);
+	return (unsigned long)(CLOCK / 1000ULL);
+}
+
+void cli(void) {
+	hostsim_sreg &= ~0x80;
+}
+
+void sei(void) {
+	hostsim_sreg |= 0x80;
+}
+
+// Sleep, the CPU wakes at the next interrupt which includes Timer0 of
+// millis(), the serial port and the events of the models
+void set_sleep_mode(uint8_t) {
+}
+
+void sleep_enable(void) {
+}
+
+void sleep_disable(void) {
+}
+
+void sleep_cpu(void) {
+	if (!(hostsim_sreg & 0x80)) {
+		DEADLOCK = true;
+		for (;;)
+			yield_host();
+	}
+	if (MT2_PENDING || ((io_get(0x3B) & _BV(PCIF0)) && (io_get(0x68) & _BV(PCIE0)))) {
+		service();
+		return;
+	}
+	uint64_t	wake = (CLOCK / TIMER0_NS + 1) * TIMER0_NS;
+	if (!EVENTS.empty())
+		wake = std::min(wake, EVENTS.begin()->first);
+	if (!RX_PENDING.empty())
+		wake = std::min(wake, RX_PENDING.front().first);
+	tx_update();
+	if (!TX_END.empty())
+		wake = std::min(wake, TX_END.front());
+	hostsim::advance(wake > CLOCK ? wake - CLOCK : 0);
+}
+
+void sleep_mode(void) {
+	sleep_enable();
+	sleep_cpu();
+	sleep_disable();
+}
+
+// MsTimer2
+void MsTimer2::set(unsigned long ms, void (*f)()) {
+	MT2_MS = ms ? ms : 1;
+	MT2_FUNC = f;
+}
+
+void MsTimer2::start(void) {
+	MT2_PENDING = false;
+	mt2_schedule(++MT2_GEN, CLOCK + MT2_MS * 1000000ULL);
+}
+
+void MsTimer2::stop(void) {
+	MT2_GEN++;
+	MT2_PENDING = false;
+}
+
+// Serial port, the divisor is chosen as HardwareSerial::begin() does
+void HardwareSerial::begin(unsigned long baud) {
+	uint16_t	setting = (F_CPU / 4 / baud - 1) / 2;
+	bool		u2x = true;
+
+	if ((F_CPU == 16000000UL && baud == 57600) || setting > 4095) {
+		u2x = false;
+		setting = (F_CPU / 8 / baud - 1) / 2;
+	}
+	BAUD = baud;
+	ACTUAL_BAUD = (double)F_CPU / ((u2x ? 8 : 16) * (setting + 1.0));
+	BYTE_NS = (uint64_t)(10e9 / ACTUAL_BAUD);
+	HOST_BYTE_NS = 10000000000ULL / baud;
+}
+
+void HardwareSerial::end(void) {
+}
+
+int HardwareSerial::available(void) {
+	rx_update();
+	if (RX_RING.empty()) {
+		rx_starved();
+		hostsim::advance(POLL_NS);
+		rx_update();
+	}
+	return RX_RING.size();
+}
+
+int HardwareSerial::peek(void) {
+	rx_update();
+	return RX_RING.empty() ? -1 : RX_RING.front();
+}
+
+int HardwareSerial::read(void) {
+	rx_update();
+	if (RX_RING.empty())
+		return -1;
+	uint8_t	c = RX_RING.front();
+	RX_RING.pop_front();
+	return c;
+}
+
+int HardwareSerial::availableForWrite(void) {
+	return SERIAL_BUFFER - 1 - tx_used();
+}
+
+void HardwareSerial::flush(void) {
+	if (TX_LAST > CLOCK)
+		hostsim::advance(TX_LAST - CLOCK);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+	// The sketch waits for a room of the ring
+	while (tx_used() >= SERIAL_BUFFER - 1)
+		hostsim::advance(TX_END.front() - CLOCK);
+	TX_LAST = std::max(CLOCK, TX_LAST) + BYTE_NS;
+	TX_END.push_back(TX_LAST);
+	RECEIVED += (char)c;
+	WRITTEN_AT.push_back(CLOCK);
+	if (PTY >= 0)
+		(void)!::write(PTY, &c, 1);
+	return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+	for (size_t i = 0; i < size; i++)
+		write(buffer[i]);
+	return size;
+}
+
+size_t HardwareSerial::print(long n, int base) {
+	if (n < 0 && base == 10)
+		return write('-') + print((unsigned long)-n, base);
+	return print((unsigned long)n, base);
+}
+
+size_t HardwareSerial::print(unsigned long n, int base) {
+	char	buf[33], *p = &buf[sizeof buf - 1];
+
+	*p = '\0';
+	do {
+		uint8_t	d = n % base;
+		*--p = d < 10 ? '0' + d : 'A' + d - 10;
+		n /= base;
+	} while (n);
+	return write(p);
+}
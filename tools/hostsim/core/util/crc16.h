@@ -0,0 +1,16 @@
+#ifndef	_UTIL_CRC16_H_
+#define	_UTIL_CRC16_H_
+
+//	util/crc16.h
+//	The C equivalent which the avr-libc manual gives.
+
+#include <stdint.h>
+
+static inline uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data) {
+	crc = crc ^ ((uint16_t)data << 8);
+	for (int i = 0; i < 8; i++)
+		crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+	return crc;
+}
+
+#endif	/* _UTIL_CRC16_H_ */
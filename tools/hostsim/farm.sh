@@ -0,0 +1,42 @@
+#!/bin/sh
+#	farm.sh
+#	This sketch licensed under the MIT License (MIT)
+#	Copyright (c) 2015 hieromon@gmail.com
+#
+#	Runs tools/ispfarm against the simulated programmers of hostsim on the
+#	pseudo-terminals, three ArduinoISP and two FuseRescue. ispfarm checks
+#	the Flash by the on-device CRC and the status of each frame, and each
+#	hostsim fails when its target model has found a violation.
+#
+#	usage: tools/hostsim/farm.sh HOSTSIM ISPFARM
+
+[ $# -eq 2 ] || { echo "usage: $0 HOSTSIM ISPFARM" >&2; exit 2; }
+HOSTSIM=$1
+ISPFARM=$2
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Start the simulated programmers, each one puts its pty path first
+for sim in isp1 isp2 isp3 fuse1 fuse2; do
+	case $sim in isp*) mode=isp;; *) mode=fuserescue;; esac
+	"$HOSTSIM" --pty $mode > "$WORK/$sim" &
+	eval PID_$sim=$!
+done
+port() {
+	while [ ! -s "$WORK/$1" ]; do sleep 0.1; done
+	head -n 1 "$WORK/$1"
+}
+ISP_PORTS="$(port isp1) $(port isp2) $(port isp3)"
+FUSE_PORTS="$(port fuse1) $(port fuse2)"
+head -c 8192 /dev/urandom > "$WORK/image.bin"
+
+status=0
+"$ISPFARM" -w 0 -n 6 -i "$WORK/image.bin" $ISP_PORTS || status=1
+"$ISPFARM" -w 0 -n 4 -f V,R,L=E2,R $FUSE_PORTS || status=1
+
+# Each hostsim ends when ispfarm has closed its port
+for sim in isp1 isp2 isp3 fuse1 fuse2; do
+	eval wait \$PID_$sim || { tail -n +2 "$WORK/$sim"; status=1; }
+done
+[ $status -eq 0 ] && echo "PASS farm" || echo "FAIL farm"
+exit $status
@@ -0,0 +1,880 @@
+//	hostsim.cpp
+//	This sketch licensed under the MIT License (MIT)
+//	Copyright (c) 2015 hieromon@gmail.com
+//
+//	Tests of the sketch on the host simulation. Each test runs the sketch
+//	from setup() in a child process against a target model, drives it
+//	through the serial port and checks the target and the replies.
+//
+//	usage: hostsim [test ...]
+//	       hostsim --pty fuserescue|isp
+//	All the tests run without the names, the benchmarks run only by them.
+//	--pty serves the sketch on a pseudo-terminal for tools/ispfarm.
+//
+//	Build it from the top of the repository, -O0 keeps avrisp() of the
+//	original ArduinoISP which falls off the end of the int function.
+//	g++ -std=gnu++11 -O0 -DARDUINO=10606 -Itools/hostsim/core -Itools/hostsim
+//		-Ilibraries/FuseRescue -Ilibraries/ArduinoISP -Ilibraries/SramArena
+//		-Ilibraries/PinTrace tools/hostsim/*.cpp tools/hostsim/core/*.cpp
+//		libraries/*/*.cpp -x c++ ISPFuseRescue.ino -o hostsim
+
+#include "hostsim.h"
+#include "target.h"
+#include "../../ISPFuseRescue.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Sketch entries of ISPFuseRescue.ino
+void	setup(void);
+void	loop(void);
+
+static bool	FAILED;
+
+static void check(bool cond, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void check(bool cond, const char *fmt, ...) {
+	va_list	ap;
+
+	if (cond)
+		return;
+	va_start(ap, fmt);
+	printf("    ");
+	vprintf(fmt, ap);
+	printf("\n");
+	va_end(ap);
+	FAILED = true;
+}
+
+static void no_violations(void) {
+	for (const std::string &v : hostsim::violations())
+		check(false, "violation: %s", v.c_str());
+}
+
+// Run the sketch until it waits for the host
+static void run(void) {
+	if (!hostsim::run())
+		check(false, "the sketch sleeps with no wake-up at %.1fms", hostsim::now() / 1e6);
+}
+
+static void boot(hostsim::Target *target, const std::string &prompt) {
+	hostsim::attach(target);
+	hostsim::expect(prompt);
+	hostsim::sketch(setup, loop);
+	run();
+}
+
+// Send the bytes and run the sketch until the reply, returns the reply
+static std::string turn(const std::string &bytes, const std::string &until = std::string()) {
+	size_t	from = hostsim::received().size();
+
+	hostsim::expect(until);
+	hostsim::send(bytes);
+	run();
+	return hostsim::received().substr(from);
+}
+
+static std::string hex(const std::string &s) {
+	std::string	h;
+	char		b[4];
+
+	for (unsigned char c : s) {
+		snprintf(b, sizeof b, "%02X ", c);
+		h += b;
+	}
+	return h;
+}
+
+// Binary protocol frame of FuseRescue
+static std::string frame(const std::string &ops) {
+	std::string	f(1, '\x02');
+	uint8_t		sum = ops.size();
+
+	f += (char)ops.size();
+	for (unsigned char c : ops)
+		sum += c;
+	return f + ops + (char)(uint8_t)-sum;
+}
+
+// STK500v1 request which ArduinoISP replies by STK_INSYNC ... STK_OK
+static std::string stk(const std::string &request) {
+	return turn(request + ' ');
+}
+
+static const std::string	OK("\x14\x10", 2);
+
+static std::string stk_params(const Chip &chip) {
+	uint16_t	page = chip.page_bytes;
+	std::string	b("B");
+
+	b += std::string("\x86\x00\x00\x01\x01\x01\x01\x03\xFF\xFF\xFF\xFF", 12);
+	b += (char)(page >> 8);
+	b += (char)page;
+	b += (char)(chip.eeprom_bytes >> 8);
+	b += (char)chip.eeprom_bytes;
+	b += (char)(chip.flash_bytes >> 24);
+	b += (char)(chip.flash_bytes >> 16);
+	b += (char)(chip.flash_bytes >> 8);
+	b += (char)chip.flash_bytes;
+	return b;
+}
+
+static std::string stk_address(uint32_t byte_addr) {
+	uint16_t	word = byte_addr / 2;
+	return std::string("U") + (char)word + (char)(word >> 8);
+}
+
+// Image of the test, pages of data and blank pages by turns
+static std::vector<uint8_t> image(const Chip &chip, uint32_t bytes) {
+	std::vector<uint8_t>	img(bytes, 0xFF);
+
+	srand(1);
+	for (uint32_t a = 0; a < bytes; a++)
+		if ((a / chip.page_bytes) % 3 != 2)
+			img[a] = rand();
+	return img;
+}
+
+// Program the image by the sequence of avrdude -c arduino -U flash:w
+static void stk_program(const Chip &chip, const std::vector<uint8_t> &img) {
+	std::string	r;
+
+	check(stk("0") == OK, "sync");
+	check(stk(stk_params(chip)) == OK, "set device");
+	check(stk(std::string("E\x05\x04\xD7\xC2\x00", 6)) == OK, "set extended device");
+	check(stk("P") == OK, "enter programming mode");
+	r = stk("u");
+	check(r == std::string("\x14", 1) + (char)(chip.signature >> 16) + (char)(chip.signature >> 8) + (char)chip.signature + '\x10',
+		"signature %s", hex(r).c_str());
+	r = stk(std::string("V\xAC\x80\x00\x00", 5));
+	check(r.size() == 3 && r[0] == '\x14' && r[2] == '\x10', "chip erase %s", hex(r).c_str());
+	check(stk("P") == OK, "enter programming mode after erase");
+	for (uint32_t a = 0; a < img.size(); a += chip.page_bytes) {
+		check(stk(stk_address(a)) == OK, "load address 0x%04X", a);
+		std::string	d("d");
+		d += (char)(chip.page_bytes >> 8);
+		d += (char)chip.page_bytes;
+		d += 'F';
+		d.append((const char *)&img[a], chip.page_bytes);
+		check(stk(d) == OK, "program page 0x%04X", a);
+	}
+}
+
+static void stk_readback(const std::vector<uint8_t> &img) {
+	for (uint32_t a = 0; a < img.size(); a += 256) {
+		uint32_t	n = std::min<uint32_t>(256, img.size() - a);
+		stk(stk_address(a));
+		std::string	t("t");
+		t += (char)(n >> 8);
+		t += (char)n;
+		t += 'F';
+		std::string	r = stk(t);
+		check(r == '\x14' + std::string((const char *)&img[a], n) + '\x10', "read page 0x%04X", a);
+	}
+}
+
+// STK500v2 message of the body, returns the body of the answer
+static std::string v2(const std::string &body) {
+	static uint8_t	seq;
+	std::string	m("\x1B", 1);
+	uint8_t		sum = 0;
+
+	m += (char)seq++;
+	m += (char)(body.size() >> 8);
+	m += (char)body.size();
+	m += '\x0E';
+	m += body;
+	for (unsigned char c : m)
+		sum ^= c;
+	std::string	r = turn(m + (char)sum);
+	if (r.size() < 6 || r[0] != '\x1B' || r[4] != '\x0E')
+		return std::string();
+	return r.substr(5, r.size() - 6);
+}
+
+static std::string bytes(std::initializer_list<uint8_t> b) {
+	return std::string(b.begin(), b.end());
+}
+
+// Memory parameters of avrdude.conf for CMD_PROGRAM_FLASH_ISP and
+// CMD_PROGRAM_EEPROM_ISP, mode, delay, cmd1, cmd2, cmd3, poll1, poll2,
+// and the bytes of a message, 0 is a page of Flash
+struct V2Memory {
+	uint8_t		mode, delay, cmd1, cmd2, cmd3, poll1, poll2;
+	uint16_t	chunk;
+};
+
+static const uint8_t	STATUS_OK = 0x00, STATUS_FAILED = 0xC0;
+
+static std::string v2_program(uint8_t cmd, const V2Memory &m, const std::string &data) {
+	std::string	b(1, (char)cmd);
+
+	b += (char)(data.size() >> 8);
+	b += (char)data.size();
+	// avrdude sends a whole page, page mode writes it at once
+	b += bytes({ (uint8_t)(m.mode & 0x01 ? m.mode | 0x80 : m.mode), m.delay, m.cmd1, m.cmd2, m.cmd3, m.poll1, m.poll2 });
+	return v2(b + data);
+}
+
+static std::string v2_address(uint32_t addr) {
+	return v2(bytes({ 0x06, 0x00, (uint8_t)(addr >> 16), (uint8_t)(addr >> 8), (uint8_t)addr }));
+}
+
+// Program the Flash and a part of EEPROM by STK500v2 as avrdude -c stk500v2
+// does, with the chip erase by CMD_SPI_MULTI as the terminal mode sends
+static void v2_session(const Chip &chip, const V2Memory &flash, const V2Memory &eeprom,
+	const std::vector<uint8_t> &img, const std::string &ee) {
+	const std::string	enter = bytes({ 0x10, 200, 100, 25, 32, 0, 0x53, 3, 0xAC, 0x53, 0x00, 0x00 });
+	std::string	r;
+
+	r = v2(bytes({ 0x01 }));
+	check(r == bytes({ 0x01, STATUS_OK, 8 }) + "AVRISP_2", "sign on %s", hex(r).c_str());
+	check(v2(enter) == bytes({ 0x10, STATUS_OK }), "enter programming mode");
+	r = v2(bytes({ 0x1D, 4, 4, 0, 0xAC, 0x80, 0x00, 0x00 }));
+	check(r.size() == 7 && r[1] == STATUS_OK, "chip erase %s", hex(r).c_str());
+	check(v2(enter) == bytes({ 0x10, STATUS_OK }), "enter programming mode after erase");
+	uint16_t	chunk = flash.chunk ? flash.chunk : chip.page_bytes;
+	for (uint32_t a = 0; a < img.size(); a += chunk) {
+		check(v2_address(a / 2) == bytes({ 0x06, STATUS_OK }), "load address 0x%04X", a);
+		r = v2_program(0x13, flash, std::string((const char *)&img[a], chunk));
+		check(r == bytes({ 0x13, STATUS_OK }), "program Flash 0x%04X %s", a, hex(r).c_str());
+	}
+	for (uint32_t a = 0; a < ee.size(); a += eeprom.chunk) {
+		check(v2_address(a) == bytes({ 0x06, STATUS_OK }), "load address 0x%04X", a);
+		r = v2_program(0x15, eeprom, ee.substr(a, eeprom.chunk));
+		check(r == bytes({ 0x15, STATUS_OK }), "program EEPROM 0x%04X %s", a, hex(r).c_str());
+	}
+	check(std::equal(img.begin(), img.end(), chip.flash.begin()), "Flash differs from the image");
+	check(std::string(chip.eeprom.begin(), chip.eeprom.begin() + ee.size()) == ee, "EEPROM differs from the data");
+	check(v2_address(0) == bytes({ 0x06, STATUS_OK }), "load address");
+	r = v2(bytes({ 0x14, 0x01, 0x00, 0x20 }));
+	check(r == bytes({ 0x14, STATUS_OK }) + std::string((const char *)&img[0], 256) + bytes({ STATUS_OK }),
+		"read Flash %s", hex(r.substr(0, 8)).c_str());
+}
+
+static std::string v2_eeprom_data(void) {
+	std::string	ee;
+
+	srand(3);
+	for (int i = 0; i < 32; i++)
+		ee += (char)rand();
+	return ee;
+}
+
+// The waits follow the mode byte, RDY/#BSY polling on the ATmega328P
+static void test_v2_program(void) {
+	Chip		chip = Chip::atmega328p();
+	IspTarget	target(chip);
+	std::vector<uint8_t>	img = image(chip, 4096);
+	std::string	r;
+
+	// External crystal of 16MHz
+	chip.fuse[0] = 0xFF;
+	boot(&target, std::string());
+	v2_session(chip, { 0x41, 6, 0x40, 0x4C, 0x20, 0xFF, 0xFF, 0 }, { 0x41, 20, 0xC1, 0xC2, 0xA0, 0xFF, 0xFF, 4 },
+		img, v2_eeprom_data());
+	check(target.polls > 0, "no polls of RDY/#BSY");
+	// The blank pages after the chip erase by CMD_SPI_MULTI are skipped
+	r = stk(std::string("A\xA1", 2));
+	check(r == std::string("\x14\x0A\x10", 3), "skipped pages %s", hex(r).c_str());
+	no_violations();
+}
+
+// The value polling on the ATmega8 which has no RDY/#BSY polling
+static void test_v2_program_atmega8(void) {
+	Chip		chip = Chip::atmega8();
+	IspTarget	target(chip);
+	std::vector<uint8_t>	img = image(chip, 2048);
+
+	// External crystal of 16MHz
+	chip.fuse[0] = 0xFF;
+	boot(&target, std::string());
+	v2_session(chip, { 0x21, 10, 0x40, 0x4C, 0x20, 0xFF, 0x00, 0 }, { 0x04, 20, 0xC0, 0x00, 0xA0, 0xFF, 0x00, 16 },
+		img, v2_eeprom_data());
+	check(target.data_polls > 0, "no value polling");
+	check(target.polls == 0, "%u polls of RDY/#BSY", target.polls);
+	no_violations();
+}
+
+// A message of 512 bytes covers four pages, each of them is committed and
+// the blank ones are still skipped
+static void test_v2_multipage(void) {
+	Chip		chip = Chip::atmega328p();
+	IspTarget	target(chip);
+	std::vector<uint8_t>	img = image(chip, 4096);
+	std::string	r;
+
+	// External crystal of 16MHz
+	chip.fuse[0] = 0xFF;
+	boot(&target, std::string());
+	v2_session(chip, { 0x41, 6, 0x40, 0x4C, 0x20, 0xFF, 0xFF, 512 }, { 0x41, 20, 0xC1, 0xC2, 0xA0, 0xFF, 0xFF, 4 },
+		img, v2_eeprom_data());
+	r = stk(std::string("A\xA1", 2));
+	check(r == std::string("\x14\x0A\x10", 3), "skipped pages %s", hex(r).c_str());
+	no_violations();
+}
+
+// PARAM_SCK_DURATION by the encoding of STK500v2, avrdude -B 2.2 sends 1
+// for 460.8kHz, SCK is taken not faster than it
+static void test_v2_sck_duration(void) {
+	Chip		chip = Chip::atmega328p();
+	IspTarget	target(chip);
+	const std::string	enter = bytes({ 0x10, 200, 100, 25, 32, 0, 0x53, 3, 0xAC, 0x53, 0x00, 0x00 });
+
+	chip.fuse[0] = 0xFF;
+	boot(&target, std::string());
+	check(v2(bytes({ 0x02, 0x98, 1 })) == bytes({ 0x02, STATUS_OK }), "set SCK duration");
+	check(v2(bytes({ 0x03, 0x98 })) == bytes({ 0x03, STATUS_OK, 1 }), "get SCK duration");
+	check(v2(enter) == bytes({ 0x10, STATUS_OK }), "enter programming mode");
+	check(target.sck > 0 && target.sck <= 460800, "SCK %uHz for 460.8kHz", target.sck);
+	check(v2(bytes({ 0x11, 1, 1 })) == bytes({ 0x11, STATUS_OK }), "leave programming mode");
+	no_violations();
+}
+
+// Malformed messages are answered by STATUS_CMD_FAILED
+static void test_v2_reject(void) {
+	Chip		chip = Chip::atmega328p();
+	IspTarget	target(chip);
+	std::string	r;
+
+	chip.fuse[0] = 0xFF;
+	boot(&target, std::string());
+	check(v2(bytes({ 0x10, 200, 100, 25, 32, 0, 0x53, 3, 0xAC, 0x53, 0x00, 0x00 })) == bytes({ 0x10, STATUS_OK }),
+		"enter programming mode");
+	// NumTx over the message
+	r = v2(bytes({ 0x1D, 200, 4, 0, 0x30, 0x00, 0x00, 0x00 }));
+	check(r == bytes({ 0x1D, STATUS_FAILED }), "CMD_SPI_MULTI over the message %s", hex(r).c_str());
+	// Flash over the buffer of 256 bytes
+	check(v2_address(0) == bytes({ 0x06, STATUS_OK }), "load address");
+	r = v2_program(0x13, { 0x40, 6, 0x40, 0x4C, 0x20, 0xFF, 0xFF, 0 }, std::string(300, '\x55'));
+	check(r == bytes({ 0x13, STATUS_FAILED }), "Flash of 300 bytes %s", hex(r).c_str());
+	check(chip.flash[0] == 0xFF, "Flash of 300 bytes is written");
+	// NumBytes over the message, the next message is still in step
+	r = v2(bytes({ 0x13, 0x00, 200, 0xC1, 6, 0x40, 0x4C, 0x20, 0xFF, 0xFF }) + std::string(10, '\x55'));
+	check(r == bytes({ 0x13, STATUS_FAILED }), "Flash of 200 bytes in 10 %s", hex(r).c_str());
+	check(chip.flash[0] == 0xFF, "Flash of 200 bytes in 10 is written");
+	r = v2(bytes({ 0x15, 0x00 }));
+	check(r == bytes({ 0x15, STATUS_FAILED }), "EEPROM without the header %s", hex(r).c_str());
+	check(v2_address(0) == bytes({ 0x06, STATUS_OK }), "load address after the malformed messages");
+	no_violations();
+}
+
+// FuseRescue identifies the target at the start
+static void test_fuserescue_verify(void) {
+	Chip		chip = Chip::atmega328p();
+	HvppTarget	target(chip);
+
+	boot(&target, "Enter command -->");
+	check(hostsim::received().find("ATmega328P(0x1E950F)") != std::string::npos, "device is not identified");
+	check(hostsim::received().find("Fuse:0x62(low),0xD9(high),0xFF(ext)  Lock:0xFF") != std::string::npos,
+		"Fuse bytes are not shown");
+	check(target.power_ups == 1, "%u power-ups for the verify", target.power_ups);
+	no_violations();
+}
+
+// Write the low Fuse and the Lock bits on the terminal
+static void test_fuserescue_write(void) {
+	Chip		chip = Chip::atmega328p();
+	HvppTarget	target(chip);
+	std::string	r;
+
+	boot(&target, "Enter command -->");
+	r = turn("L\rE2\rY\r", "Enter command -->");
+	check(chip.fuse[0] == 0xE2, "low Fuse 0x%02X", chip.fuse[0]);
+	check(r.find("complete.") != std::string::npos, "low Fuse is not complete");
+	r = turn("K\rFC\rY\r", "Enter command -->");
+	check(chip.lock == 0xFC, "Lock bits 0x%02X", chip.lock);
+	check(chip.fuse[0] == 0xE2, "low Fuse 0x%02X after the Lock bits", chip.fuse[0]);
+	check(r.find("complete.") != std::string::npos, "Lock bits are not complete");
+	no_violations();
+}
+
+// Binary protocol of FuseRescue, a frame is one power-up
+static void test_fuserescue_frame(void) {
+	Chip		chip = Chip::atmega328p();
+	HvppTarget	target(chip);
+	std::string	r;
+	uint32_t	power_ups;
+
+	boot(&target, "Enter command -->");
+	power_ups = target.power_ups;
+	r = turn(frame("VRL\xE2"));
+	check(r == frame(std::string("\x00V\x00\x1E\x95\x0FR\x00\x62\xD9\xFF\xFFL\x00\xE2", 15)), "reply %s", hex(r).c_str());
+	check(target.power_ups == power_ups + 1, "%u power-ups for a frame", target.power_ups - power_ups);
+	check(chip.fuse[0] == 0xE2, "low Fuse 0x%02X", chip.fuse[0]);
+	// The frames which do not access the target leave it unpowered
+	power_ups = target.power_ups;
+	r = turn(frame("T"));
+	check(r.size() == 16 && r[2] == 0x00, "reply of T %s", hex(r).c_str());
+	r = turn(frame("L"));
+	check(r == frame(std::string("\x00L\x04", 3)), "reply of L without the value %s", hex(r).c_str());
+	std::string	bad = frame("V");
+	bad[bad.size() - 1] ^= 0x01;
+	r = turn(bad);
+	check(r == frame(std::string("\x02", 1)), "reply of the checksum error %s", hex(r).c_str());
+	check(target.power_ups == power_ups, "%u power-ups without the target access", target.power_ups - power_ups);
+	no_violations();
+}
+
+// Run (fn) at the first check of (cond) that holds, checked every 50us
+static void when(std::function<bool()> cond, std::function<void()> fn) {
+	hostsim::at(hostsim::now() + 50000, [cond, fn]() {
+		if (cond())
+			fn();
+		else
+			when(cond, fn);
+	});
+}
+
+// ESC while the target is busy aborts the write after RDY/#BSY
+static void test_fuserescue_abort(void) {
+	Chip		chip = Chip::atmega328p();
+	HvppTarget	target(chip);
+	std::string	r;
+
+	bool		busy_at_abort = false;
+
+	boot(&target, "Enter command -->");
+	size_t	from = hostsim::received().size();
+	when([&target]() { return target.programming(); }, []() { hostsim::send("\x1B"); });
+	when([from]() { return hostsim::received().find("Aborted", from) != std::string::npos; },
+		[&target, &busy_at_abort]() { busy_at_abort = target.programming(); });
+	r = turn("L\rE2\rY\r", "Enter command -->");
+	check(r.find("Aborted") != std::string::npos, "write is not aborted");
+	check(!busy_at_abort, "aborted while RDY/#BSY is busy");
+	// The write has completed before the abort
+	check(chip.fuse[0] == 0xE2, "low Fuse 0x%02X", chip.fuse[0]);
+	no_violations();
+}
+
+// The chip erase which times out is retried after the power cycle
+static void test_fuserescue_erase_retry(void) {
+	Chip		chip = Chip::atmega328p();
+	HvppTarget	target(chip);
+	std::string	r;
+	uint32_t	power_ups;
+
+	boot(&target, "Enter command -->");
+	target.erase_hangs = 1;
+	power_ups = target.power_ups;
+	r = turn("E\rY\r", "Enter command -->");
+	check(r.find("complete.") != std::string::npos, "chip erase is not complete");
+	check(target.power_ups == power_ups + 2, "%u power-ups for the chip erase", target.power_ups - power_ups);
+	no_violations();
+}
+
+// The dump covers the whole EEPROM of the ATmega8, which is 512 bytes
+static void test_fuserescue_dump_atmega8(void) {
+	Chip		chip = Chip::atmega8();
+	HvppTarget	target(chip);
+	std::string	r;
+
+	chip.eeprom[chip.eeprom_bytes - 1] = 0x5A;
+	boot(&target, "Enter command -->");
+	r = turn("D\rY\r", "Enter command -->");
+	size_t	eeprom = r.find("EEPROM:");
+	check(eeprom != std::string::npos, "EEPROM is not dumped");
+	check(r.find(":1001F000FFFFFFFFFFFFFFFFFFFFFFFFFFFFFF5A", eeprom) != std::string::npos,
+		"last EEPROM record is not dumped");
+	check(r.find(":10020000", eeprom) == std::string::npos, "EEPROM is dumped beyond 512 bytes");
+	// The safe profile identifies the device by the window of the ATmega48/88/168/328
+	// family, only that first power-up is too early for the ATmega8
+	const std::vector<std::string>	&v = hostsim::violations();
+	check(v.size() == 1 && v[0].find("+12V") != std::string::npos, "%zu violations", v.size());
+}
+
+// Program and read back the Flash by ArduinoISP as avrdude does
+static void test_isp_program(void) {
+	Chip		chip = Chip::atmega328p();
+	IspTarget	target(chip);
+	std::vector<uint8_t>	img = image(chip, 8192);
+
+	// External crystal of 16MHz
+	chip.fuse[0] = 0xFF;
+
+	boot(&target, std::string());
+	stk_program(chip, img);
+	check(std::equal(img.begin(), img.end(), chip.flash.begin()), "Flash differs from the image");
+	// The blank pages after the chip erase are skipped
+	std::string	lo = stk(std::string("A\xA1", 2)), hi = stk(std::string("A\xA2", 2));
+	check(lo == std::string("\x14\x15\x10", 3) && hi == std::string("\x14\x00\x10", 3),
+		"skipped pages %s %s", hex(lo).c_str(), hex(hi).c_str());
+	stk_readback(img);
+	check(stk("Q") == OK, "leave programming mode");
+	no_violations();
+}
+
+// A page whose CRC_EOP is broken is answered by STK_NOSYNC and it is
+// not committed, the next page goes on
+static void test_isp_nosync(void) {
+	Chip		chip = Chip::atmega328p();
+	IspTarget	target(chip);
+	std::string	d("d\x00\x80" "F", 4);
+	std::string	r;
+
+	chip.fuse[0] = 0xFF;
+	boot(&target, std::string());
+	stk_program(chip, std::vector<uint8_t>());
+	d.append(chip.page_bytes, '\x55');
+	check(stk(std::string("U\x00\x00", 3)) == OK, "load address");
+	r = turn(d + 'X');
+	check(r == std::string("\x15", 1), "reply of the broken page %s", hex(r).c_str());
+	check(chip.flash[0] == 0xFF && chip.flash[chip.page_bytes - 1] == 0xFF, "the broken page is written");
+	check(stk("0") == OK, "sync");
+	check(stk(std::string("U\x00\x00", 3)) == OK, "load address");
+	check(stk(d) == OK, "program page");
+	check(chip.flash[0] == 0x55 && chip.flash[chip.page_bytes - 1] == 0x55, "the page is not written");
+	check(stk("Q") == OK, "leave programming mode");
+	no_violations();
+}
+
+// The factory default of 1MHz, the calibration tries SCK over fck/4 and
+// the target has to get back in step before the programming
+static void test_isp_program_1mhz(void) {
+	Chip		chip = Chip::atmega328p();
+	IspTarget	target(chip);
+	std::vector<uint8_t>	img = image(chip, 1024);
+
+	boot(&target, std::string());
+	stk_program(chip, img);
+	check(std::equal(img.begin(), img.end(), chip.flash.begin()), "Flash differs from the image");
+	stk_readback(img);
+	check(stk("Q") == OK, "leave programming mode");
+	no_violations();
+}
+
+// The ATmega8 lacks Poll RDY/#BSY, the fixed waits pace the programming
+// even though avrdude sets the polling parameter
+static void test_isp_atmega8(void) {
+	Chip		chip = Chip::atmega8();
+	IspTarget	target(chip);
+	std::vector<uint8_t>	img = image(chip, 4096);
+
+	// External crystal of 16MHz
+	chip.fuse[0] = 0xFF;
+
+	boot(&target, std::string());
+	stk_program(chip, img);
+	check(std::equal(img.begin(), img.end(), chip.flash.begin()), "Flash differs from the image");
+	stk_readback(img);
+	check(stk("Q") == OK, "leave programming mode");
+	check(target.polls == 0, "%u polls of RDY/#BSY", target.polls);
+	no_violations();
+}
+
+// Write and read back a part of EEPROM as avrdude -U eeprom:w does
+static void isp_eeprom(Chip &chip) {
+	IspTarget	target(chip);
+	std::string	data, r;
+
+	// External crystal of 16MHz
+	chip.fuse[0] = 0xFF;
+	srand(2);
+	for (int i = 0; i < 40; i++)
+		data += (char)rand();
+
+	boot(&target, std::string());
+	check(stk("0") == OK, "sync");
+	check(stk(stk_params(chip)) == OK, "set device");
+	// avrdude gives the EEPROM page of 4 bytes for the ATmega8 as well
+	check(stk(std::string("E\x05\x04\xD7\xC2\x00", 6)) == OK, "set extended device");
+	check(stk("P") == OK, "enter programming mode");
+	// From the middle of a page
+	check(stk(stk_address(0x12)) == OK, "load address");
+	check(stk(std::string("d\x00", 2) + (char)data.size() + 'E' + data) == OK, "program EEPROM");
+	check(std::string(chip.eeprom.begin() + 0x12, chip.eeprom.begin() + 0x12 + data.size()) == data, "EEPROM differs from the data");
+	check(chip.eeprom[0x11] == 0xFF && chip.eeprom[0x12 + data.size()] == 0xFF, "EEPROM out of the data is altered");
+	check(stk(stk_address(0x12)) == OK, "load address");
+	r = stk(std::string("t\x00", 2) + (char)data.size() + 'E');
+	check(r == '\x14' + data + '\x10', "read EEPROM %s", hex(r).c_str());
+	check(stk("Q") == OK, "leave programming mode");
+	no_violations();
+}
+
+static void test_isp_eeprom(void) {
+	Chip	chip = Chip::atmega328p();
+	isp_eeprom(chip);
+}
+
+// The ATmega8 has no EEPROM page access, it is written byte by byte
+static void test_isp_eeprom_atmega8(void) {
+	Chip	chip = Chip::atmega8();
+	isp_eeprom(chip);
+}
+
+// The error which the sketch asserts at the compile time is the one of
+// the divisor HardwareSerial takes
+static void test_serial_baud(void) {
+	for (const uint32_t *rates : { ISP_RATES, FUSERESCUE_RATES }) {
+		size_t	n = rates == ISP_RATES ? sizeof ISP_RATES / sizeof(uint32_t) : sizeof FUSERESCUE_RATES / sizeof(uint32_t);
+		for (size_t i = 0; i < n; i++) {
+			Serial.begin(rates[i]);
+			int32_t	error = ((int32_t)hostsim::actual_baud() - (int32_t)rates[i]) * 1000 / (int32_t)rates[i];
+			check(error == serial_error(rates[i]), "%u baud, %d of serial_error and %d of HardwareSerial",
+				rates[i], serial_error(rates[i]), error);
+		}
+	}
+}
+
+// Benchmarks, they run only by the names and put the figures.
+// The simulated time counts the delays and the serial transfer, the CPU
+// time of the sketch is not counted, and the cycles of the AVR need the
+// avr-gcc build on a simulator of the AVR core.
+
+// The bus access before the port masks, a pin at a time by digitalWrite
+static void old_transmit_data(uint8_t data) {
+	for (uint8_t bit_count = 0; bit_count < 8; bit_count++) {
+		pinMode(PGM_DATA[bit_count], OUTPUT);
+		digitalWrite(PGM_DATA[bit_count], data & 0x01);
+		data >>= 1;
+	}
+	digitalWrite(XTAL1, HIGH);
+	delayMicroseconds(1);
+	digitalWrite(XTAL1, LOW);
+	delayMicroseconds(1);
+}
+
+static uint8_t old_retrieve_data(void) {
+	uint8_t	read_byte = 0x00;
+
+	digitalWrite(OE, LOW);
+	for (int8_t bit_count = 7; bit_count >= 0; bit_count--) {
+		read_byte <<= 1;
+		pinMode(PGM_DATA[bit_count], INPUT);
+		if (digitalRead(PGM_DATA[bit_count]) == HIGH)
+			read_byte |= 0x01;
+	}
+	digitalWrite(OE, HIGH);
+	delay(1);
+	return read_byte;
+}
+
+static void old_load(uint8_t xa1, uint8_t xa0, uint8_t value) {
+	digitalWrite(XA1, xa1);
+	digitalWrite(XA0, xa0);
+	digitalWrite(BS1, LOW);
+	old_transmit_data(value);
+}
+
+// Stores into the I/O registers and the calls of digitalWrite to read the
+// signature bytes, by the port masks and by the former digitalWrite path
+static void bench_hvpp_bus(void) {
+	Chip		chip = Chip::atmega328p();
+	HvppTarget	target(chip);
+	const int	N = 100;
+
+	boot(&target, "Enter command -->");
+	FuseRescue::PgmSession::enter();
+	for (int path = 0; path < 2; path++) {
+		uint32_t	sig = 0;
+		uint64_t	t = hostsim::now();
+
+		hostsim::reset_counters();
+		for (int n = 0; n < N; n++) {
+			if (path) {
+				old_load(HIGH, LOW, 0x08);
+				for (uint8_t i = 0; i < 3; i++) {
+					old_load(LOW, LOW, i);
+					sig = sig << 8 | old_retrieve_data();
+				}
+			} else {
+				FuseRescue::load_command(0x08);
+				for (uint8_t i = 0; i < 3; i++) {
+					FuseRescue::load_address_low(i);
+					sig = sig << 8 | FuseRescue::retrieve_data();
+				}
+			}
+		}
+		hostsim::Counters	&c = hostsim::counters();
+		printf("    %-12s signature 0x%06X, per byte %5.1f I/O stores %5.1f digitalWrite %5.1f pin changes %7.1fus\n",
+			path ? "digitalWrite" : "port masks", sig & 0xFFFFFF, c.io_writes / (3.0 * N), c.digital_writes / (3.0 * N),
+			hostsim::toggles() / (3.0 * N), (hostsim::now() - t) / (3e3 * N));
+		check((sig & 0xFFFFFF) == chip.signature, "signature 0x%06X", sig & 0xFFFFFF);
+	}
+	FuseRescue::PgmSession::leave();
+}
+
+// Flash write and read throughput of ArduinoISP by STK500v1 and STK500v2
+// at each baud rate of Parm_ISP_BAUD, a page of 128 bytes at a time as
+// avrdude -c arduino and -c stk500v2 send
+static void bench_isp_throughput(void) {
+	Chip		chip = Chip::atmega328p();
+	IspTarget	target(chip);
+	const uint32_t	rates[] = { ISP_BAUD_RATES };
+	const std::string	enter = bytes({ 0x10, 200, 100, 25, 32, 0, 0x53, 3, 0xAC, 0x53, 0x00, 0x00 });
+	std::vector<uint8_t>	img(16384);
+
+	// External crystal of 16MHz
+	chip.fuse[0] = 0xFF;
+	srand(4);
+	for (uint8_t &b : img)
+		b = rand();
+	boot(&target, std::string());
+	for (uint8_t v = 0; v < sizeof rates / sizeof rates[0]; v++) {
+		check(stk(std::string("@\xA0", 2) + (char)v) == OK, "switch to %u baud", rates[v]);
+		check(hostsim::baud() == rates[v], "%u baud of the sketch", hostsim::baud());
+		uint32_t	overruns = hostsim::overruns();
+		stk_program(chip, std::vector<uint8_t>());
+		uint64_t	t = hostsim::now();
+		for (uint32_t a = 0; a < img.size(); a += chip.page_bytes) {
+			std::string	d("U");
+			d += (char)(a / 2);
+			d += (char)(a / 2 >> 8);
+			stk(d);
+			d = "d";
+			d += (char)(chip.page_bytes >> 8);
+			d += (char)chip.page_bytes;
+			d += 'F';
+			d.append((const char *)&img[a], chip.page_bytes);
+			stk(d);
+		}
+		double	write = (hostsim::now() - t) / 1e9;
+		check(std::equal(img.begin(), img.end(), chip.flash.begin()), "Flash differs at %u baud", rates[v]);
+		t = hostsim::now();
+		stk_readback(img);
+		double	read = (hostsim::now() - t) / 1e9;
+		check(stk("Q") == OK, "leave programming mode");
+		printf("    %7u baud  v1  write %6.2fs %5.1fKB/s  read %6.2fs %5.1fKB/s  overruns %u\n",
+			rates[v], write, img.size() / 1024.0 / write, read, img.size() / 1024.0 / read, hostsim::overruns() - overruns);
+
+		overruns = hostsim::overruns();
+		check(v2(enter) == bytes({ 0x10, STATUS_OK }), "enter programming mode");
+		std::string	r = v2(bytes({ 0x1D, 4, 4, 0, 0xAC, 0x80, 0x00, 0x00 }));
+		check(r.size() == 7 && r[1] == STATUS_OK, "chip erase %s", hex(r).c_str());
+		check(v2(enter) == bytes({ 0x10, STATUS_OK }), "enter programming mode after erase");
+		t = hostsim::now();
+		for (uint32_t a = 0; a < img.size(); a += chip.page_bytes) {
+			check(v2_address(a / 2) == bytes({ 0x06, STATUS_OK }), "load address 0x%04X", a);
+			r = v2_program(0x13, { 0x41, 6, 0x40, 0x4C, 0x20, 0xFF, 0xFF, 0 },
+				std::string((const char *)&img[a], chip.page_bytes));
+			check(r == bytes({ 0x13, STATUS_OK }), "program Flash 0x%04X %s", a, hex(r).c_str());
+		}
+		write = (hostsim::now() - t) / 1e9;
+		check(std::equal(img.begin(), img.end(), chip.flash.begin()), "Flash differs at %u baud by v2", rates[v]);
+		t = hostsim::now();
+		for (uint32_t a = 0; a < img.size(); a += 256) {
+			check(v2_address(a / 2) == bytes({ 0x06, STATUS_OK }), "load address 0x%04X", a);
+			r = v2(bytes({ 0x14, 0x01, 0x00, 0x20 }));
+			check(r == bytes({ 0x14, STATUS_OK }) + std::string((const char *)&img[a], 256) + bytes({ STATUS_OK }),
+				"read Flash 0x%04X by v2", a);
+		}
+		read = (hostsim::now() - t) / 1e9;
+		check(v2(bytes({ 0x11, 1, 1 })) == bytes({ 0x11, STATUS_OK }), "leave programming mode");
+		printf("    %7u baud  v2  write %6.2fs %5.1fKB/s  read %6.2fs %5.1fKB/s  overruns %u\n",
+			rates[v], write, img.size() / 1024.0 / write, read, img.size() / 1024.0 / read, hostsim::overruns() - overruns);
+	}
+	no_violations();
+}
+
+// Menu render of FuseRescue at each baud rate, from the rule line to the
+// prompt after a verify. The ring of 64 bytes is still full of the verify
+// output, so the sketch waits for the UART at each byte of the menu.
+static void bench_menu_render(void) {
+	Chip		chip = Chip::atmega328p();
+	HvppTarget	target(chip);
+	const uint32_t	rates[] = { FUSERESCUE_BAUD_RATES };
+
+	boot(&target, "Enter command -->");
+	for (uint8_t v = 0; v < sizeof rates / sizeof rates[0]; v++) {
+		turn(frame(std::string("S") + (char)v));
+		check(hostsim::baud() == rates[v], "%u baud of the sketch", hostsim::baud());
+		size_t	from = hostsim::received().size();
+		turn("V\r", "Enter command -->");
+		const std::string	&r = hostsim::received();
+		size_t	rule = r.find("\r\n____", from);
+		size_t	prompt = r.find("\r\nEnter command -->", rule);
+		check(rule != std::string::npos && prompt != std::string::npos, "menu is not rendered at %u baud", rates[v]);
+		if (FAILED)
+			return;
+		double	render = (hostsim::written_at(prompt) - hostsim::written_at(rule)) / 1e6;
+		printf("    %7u baud  %u bytes  render %7.2fms  on the wire %7.2fms\n", rates[v], (unsigned)(prompt - rule),
+			render, (prompt - rule) * 10e3 / hostsim::actual_baud());
+	}
+	no_violations();
+}
+
+static const struct {
+	const char	*name;
+	void		(*run)(void);
+	bool		bench;
+} TESTS[] = {
+	{ "fuserescue_verify", test_fuserescue_verify },
+	{ "fuserescue_write", test_fuserescue_write },
+	{ "fuserescue_frame", test_fuserescue_frame },
+	{ "fuserescue_abort", test_fuserescue_abort },
+	{ "fuserescue_erase_retry", test_fuserescue_erase_retry },
+	{ "fuserescue_dump_atmega8", test_fuserescue_dump_atmega8 },
+	{ "isp_program", test_isp_program },
+	{ "isp_nosync", test_isp_nosync },
+	{ "isp_program_1mhz", test_isp_program_1mhz },
+	{ "isp_atmega8", test_isp_atmega8 },
+	{ "isp_eeprom", test_isp_eeprom },
+	{ "isp_eeprom_atmega8", test_isp_eeprom_atmega8 },
+	{ "v2_program", test_v2_program },
+	{ "v2_program_atmega8", test_v2_program_atmega8 },
+	{ "v2_multipage", test_v2_multipage },
+	{ "v2_sck_duration", test_v2_sck_duration },
+	{ "v2_reject", test_v2_reject },
+	{ "serial_baud", test_serial_baud },
+	{ "bench_hvpp_bus", bench_hvpp_bus, true },
+	{ "bench_isp_throughput", bench_isp_throughput, true },
+	{ "bench_menu_render", bench_menu_render, true },
+};
+
+// Serve the sketch on a pseudo-terminal for a host tool such as ispfarm,
+// against the ATmega328P at 16MHz. It puts the path of the pty and runs
+// until the tool closes the port, the exit status tells the violations.
+static int serve_pty(const char *mode) {
+	Chip		chip = Chip::atmega328p();
+	HvppTarget	hvpp(chip);
+	IspTarget	isp(chip);
+	std::string	path;
+
+	if (strcmp(mode, "fuserescue") && strcmp(mode, "isp")) {
+		fprintf(stderr, "usage: hostsim --pty fuserescue|isp\n");
+		return 2;
+	}
+	if (hostsim::open_pty(path) < 0) {
+		perror("hostsim");
+		return 2;
+	}
+	// External crystal of 16MHz
+	chip.fuse[0] = 0xFF;
+	hostsim::attach(mode[0] == 'i' ? (hostsim::Target *)&isp : &hvpp);
+	printf("%s\n", path.c_str());
+	fflush(stdout);
+	hostsim::sketch(setup, loop);
+	run();
+	no_violations();
+	return FAILED ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+	int		failures = 0;
+
+	if (argc == 3 && !strcmp(argv[1], "--pty"))
+		return serve_pty(argv[2]);
+	for (auto &t : TESTS) {
+		bool	selected = argc < 2 && !t.bench;
+		for (int i = 1; i < argc; i++)
+			selected |= !strcmp(argv[i], t.name);
+		if (!selected)
+			continue;
+		fflush(stdout);
+		// The sketch keeps its state in the statics, a child runs each test
+		pid_t	pid = fork();
+		if (pid == 0) {
+			t.run();
+			fflush(stdout);
+			_exit(FAILED ? 1 : 0);
+		}
+		int	status;
+		waitpid(pid, &status, 0);
+		bool	pass = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+		printf("%s %s\n", pass ? "PASS" : "FAIL", t.name);
+		failures += !pass;
+	}
+	return failures ? 1 : 0;
+}
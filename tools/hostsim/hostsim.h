@@ -0,0 +1,98 @@
+#ifndef	__HOSTSIM_H_
+#define	__HOSTSIM_H_
+
+//	hostsim.h
+//	This sketch licensed under the MIT License (MIT)
+//	Copyright (c) 2015 hieromon@gmail.com
+//
+//	Host simulation of the Uno which runs the libraries of the sketch.
+//	The fake Arduino core in core/ keeps the I/O registers in a page which
+//	is write protected, each store of the sketch traps and the models see
+//	the pins change at the simulated time. The time advances only by the
+//	delays, the polling of the serial port and the timers, the SPI
+//	transfers and the sleep, so the CPU time of the sketch itself is not
+//	counted.
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace hostsim {
+	// Arduino pins of the Uno, D0-D13 and A0-A5
+	const int	PINS = 20;
+	// Level seen on a pin, Z is neither driven nor pulled up
+	const int8_t	Z = -1;
+
+	// Simulated clock by nanoseconds
+	uint64_t	now(void);
+	void		advance(uint64_t ns);
+	// Run a function at the simulated time from the model
+	void		at(uint64_t ns, std::function<void()> fn);
+
+	// The sketch runs on its own stack from setup() and loop(), run()
+	// resumes it until it polls the serial port with nothing to come, so
+	// the sketch keeps its place inside loop() across the calls. run()
+	// returns false if the sketch sleeps with nothing to wake it up.
+	void	sketch(void (*setup)(void), void (*loop)(void));
+	bool	run(void);
+
+	// Model of the chip on the other side of the pins
+	class Target {
+	public:
+		virtual ~Target() {}
+		// A pin which is driven by the Uno has changed, level[] is the
+		// level of each pin which the Uno drives or Z
+		virtual void pins(const int8_t *level) = 0;
+		// A byte exchange on SPI at the SCK frequency, returns MISO
+		virtual uint8_t spi(uint8_t mosi, uint32_t sck_hz) { (void)mosi; (void)sck_hz; return 0xFF; }
+	};
+	void	attach(Target *target);
+	// The target drives a pin, Z releases it
+	void	drive(int pin, int8_t level);
+	// Violation of the datasheet which a model found
+	void	violation(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+	const std::vector<std::string>	&violations(void);
+
+	// Serial port seen from the host, the host sends the bytes at the baud
+	// rate of the sketch from the time of send() or when the previous
+	// bytes have been sent, whichever is later.
+	void	send(const void *data, size_t len);
+	void	send(const std::string &s);
+	// Bytes which the sketch has transmitted, and the simulated time when
+	// the last one has left the UART
+	const std::string	&received(void);
+	uint64_t	received_at(void);
+	// Simulated time when the sketch has put the (i)th byte of received()
+	uint64_t	written_at(size_t i);
+	// run() returns when the sketch polls the port with nothing to come
+	// and (text) has been received since this call. With the empty text
+	// it returns as soon as the transmission has drained, which is the
+	// end of a turn of the binary protocols.
+	void	expect(const std::string &text);
+	// run() returns when the port stays quiet for (ns) anyway
+	void	quiet_limit(uint64_t ns);
+	// Current baud rate of the sketch and the actual rate of its divisor
+	uint32_t	baud(void);
+	double		actual_baud(void);
+	// Bytes lost because the receive buffer of 64 bytes was full
+	uint32_t	overruns(void);
+	// Serve the port on a pseudo-terminal instead of the script, the
+	// sketch waits for the host in real time. run() returns when the host
+	// closes the port after it has sent something.
+	int		open_pty(std::string &path);
+
+	// Counters for the benchmarks
+	struct Counters {
+		uint64_t	io_writes;				// Stores into the I/O registers
+		uint64_t	toggles[PINS];			// Level changes of each pin
+		uint64_t	spi_bytes;				// SPI transfers
+		uint64_t	digital_writes;			// Calls of digitalWrite
+	};
+	Counters	&counters(void);
+	uint64_t	toggles(void);				// Sum of all the pins
+	void		reset_counters(void);
+};
+
+#endif	/* __HOSTSIM_H_ */
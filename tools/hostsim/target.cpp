@@ -0,0 +1,544 @@
+//	target.cpp
+//	This sketch licensed under the MIT License (MIT)
+//	Copyright (c) 2015 hieromon@gmail.com
+//
+//	Models of the target chip for the host simulation.
+
+#include "target.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// Pins of the Uno, the same as devicesig.h and ArduinoISP.h
+#define	P_VCC		7
+#define	P_HV		13
+#define	P_RDY		12
+#define	P_OE		11
+#define	P_WR		14
+#define	P_BS1		15
+#define	P_XTAL1		16
+#define	P_XA0		17
+#define	P_XA1		18
+#define	P_BS2		10
+#define	P_ACTMODE	14
+#define	P_RESET		10
+static const int	P_DATA[] = { 19, 2, 3, 4, 5, 6, 8, 9 };
+
+// Parallel programming waits of the 28-pin megaAVR, the datasheet maximum
+#define	T_WLRH		4500				// #WR low to RDY/#BSY high (us)
+#define	T_WLRH_CE	9000				// Same for the chip erase (us)
+#define	T_HOLD		10					// Prog_enable pins held after +12V (us)
+#define	T_WLWH		150					// #WR pulse width, the minimum (ns)
+#define	T_RDY		20					// RDY/#BSY is driven after +12V (us)
+// Serial programming
+#define	T_RST		20000				// RESET low to Programming Enable (us)
+#define	MARGINAL	50					// A byte of this count is corrupted at the marginal SCK
+
+static bool high(int8_t level) {
+	return level == 1;
+}
+
+Chip Chip::atmega328p(void) {
+	Chip	c;
+
+	c.name = "ATmega328P";
+	c.signature = 0x1E950F;
+	c.calibration = 0x9C;
+	c.fuse[0] = 0x62;
+	c.fuse[1] = 0xD9;
+	c.fuse[2] = 0xFF;
+	c.ext_bits = 0x07;
+	c.lock = 0xFF;
+	c.has_ext = c.has_poll = c.has_eepage = true;
+	c.flash_bytes = 32768;
+	c.page_bytes = 128;
+	c.eeprom_bytes = 1024;
+	c.eepage_bytes = 4;
+	c.t_wd_fuse = 4500;
+	c.t_wd_flash = 2600;
+	c.t_wd_eeprom = 3600;
+	c.t_wd_erase = 10500;
+	c.t_vcc_min = 20;
+	c.t_vcc_max = 60;
+	c.t_enter = 300;
+	c.flash.assign(c.flash_bytes, 0xFF);
+	c.eeprom.assign(c.eeprom_bytes, 0xFF);
+	return c;
+}
+
+Chip Chip::atmega8(void) {
+	Chip	c;
+
+	c.name = "ATmega8";
+	c.signature = 0x1E9307;
+	c.calibration = 0xA5;
+	c.fuse[0] = 0xE1;
+	c.fuse[1] = 0xD9;
+	c.fuse[2] = 0x00;
+	c.ext_bits = 0x00;
+	c.lock = 0xFF;
+	c.has_ext = c.has_poll = c.has_eepage = false;
+	c.flash_bytes = 8192;
+	c.page_bytes = 64;
+	c.eeprom_bytes = 512;
+	c.eepage_bytes = 0;
+	c.t_wd_fuse = 4500;
+	c.t_wd_flash = 4500;
+	c.t_wd_eeprom = 9000;
+	c.t_wd_erase = 9000;
+	c.t_vcc_min = 100;
+	c.t_vcc_max = UINT32_MAX;
+	c.t_enter = 50;
+	c.flash.assign(c.flash_bytes, 0xFF);
+	c.eeprom.assign(c.eeprom_bytes, 0xFF);
+	return c;
+}
+
+uint32_t Chip::fck(void) const {
+	uint8_t	cksel = fuse[0] & 0x0F;
+
+	if (!has_ext) {
+		// ATmega8 has the calibrated RC of 1, 2, 4 and 8MHz and no CKDIV8
+		if (cksel >= 1 && cksel <= 4)
+			return 1000000UL << (cksel - 1);
+		return 16000000UL;
+	}
+	uint32_t	f = cksel == 0x02 ? 8000000UL : (cksel == 0x03 ? 128000UL : 16000000UL);
+	return fuse[0] & 0x80 ? f : f / 8;
+}
+
+void Chip::erase(void) {
+	std::fill(flash.begin(), flash.end(), 0xFF);
+	// EESAVE of the high Fuse preserves EEPROM
+	if (fuse[1] & 0x08)
+		std::fill(eeprom.begin(), eeprom.end(), 0xFF);
+	lock = 0xFF;
+}
+
+// The mode select pin follows the board while VCC is on at the sensing
+void Board::sense_mode(const int8_t *level) {
+	if (sensed)
+		return;
+	if (high(level[P_VCC])) {
+		hostsim::drive(P_ACTMODE, fuserescue ? 1 : 0);
+		sensing = true;
+	} else if (sensing) {
+		hostsim::drive(P_ACTMODE, hostsim::Z);
+		sensed = true;
+	}
+}
+
+// Parallel programming
+void HvppTarget::pins(const int8_t *level) {
+	uint64_t	now = hostsim::now();
+
+	sense_mode(level);
+	if (high(level[P_VCC]) && !vcc) {
+		vcc = true;
+		t_vcc = now;
+	} else if (!high(level[P_VCC]) && vcc) {
+		vcc = false;
+		leave();
+	}
+	if (high(level[P_HV]) && !hv) {
+		hv = true;
+		enter(level);
+	} else if (!high(level[P_HV]) && hv) {
+		hv = false;
+		leave();
+	}
+	if (active) {
+		// Prog_enable pins are latched by +12V
+		if (now < t_hv + T_HOLD * 1000ULL &&
+			(level[P_XA1] != last[P_XA1] || level[P_XA0] != last[P_XA0] || level[P_BS1] != last[P_BS1]))
+			hostsim::violation("Prog_enable pins changed %.1fus after +12V", (now - t_hv) / 1000.0);
+		if (high(level[P_XTAL1]) && !high(last[P_XTAL1]))
+			strobe(level);
+		if (level[P_WR] == 0 && high(last[P_WR])) {
+			t_wr = now;
+			write(level);
+		} else if (high(level[P_WR]) && last[P_WR] == 0 && now < t_wr + T_WLWH)
+			hostsim::violation("#WR pulse of %uns, t_WLWH is %uns", (unsigned)(now - t_wr), T_WLWH);
+		if (level[P_OE] == 0 && high(last[P_OE]))
+			read(level);
+		else if (high(level[P_OE]) && last[P_OE] == 0 && driving) {
+			for (int p : P_DATA)
+				hostsim::drive(p, hostsim::Z);
+			driving = false;
+		}
+	}
+	memcpy(last, level, sizeof last);
+}
+
+void HvppTarget::enter(const int8_t *level) {
+	uint64_t	now = hostsim::now();
+
+	if (!vcc) {
+		hostsim::violation("+12V without VCC");
+		return;
+	}
+	double	us = (now - t_vcc) / 1000.0;
+	if (us < chip.t_vcc_min || us > chip.t_vcc_max)
+		hostsim::violation("+12V %.1fus after VCC, %u-%uus for %s", us, chip.t_vcc_min, chip.t_vcc_max, chip.name);
+	if (level[P_XA1] != 0 || level[P_XA0] != 0 || level[P_BS1] != 0)
+		hostsim::violation("Prog_enable pins are not 0 at +12V");
+	active = true;
+	t_hv = now;
+	busy_until = 0;
+	command = 0;
+	power_ups++;
+	// RDY/#BSY is driven after the Uno has released it
+	unsigned	gen = ++busy_gen;
+	hostsim::at(now + T_RDY * 1000ULL, [this, gen]() {
+		if (gen == busy_gen && active)
+			hostsim::drive(P_RDY, 1);
+	});
+}
+
+void HvppTarget::leave(void) {
+	if (!active)
+		return;
+	if (hostsim::now() < busy_until && !hung)
+		hostsim::violation("power-off while RDY/#BSY is busy");
+	active = false;
+	hung = false;
+	busy_until = 0;
+	busy_gen++;
+	hostsim::drive(P_RDY, hostsim::Z);
+	for (int p : P_DATA)
+		hostsim::drive(p, hostsim::Z);
+	driving = false;
+}
+
+uint8_t HvppTarget::bus(const int8_t *level) {
+	uint8_t	value = 0;
+
+	for (int b = 0; b < 8; b++) {
+		if (level[P_DATA[b]] == hostsim::Z) {
+			hostsim::violation("DATA%d is not driven at XTAL1", b);
+			continue;
+		}
+		if (high(level[P_DATA[b]]))
+			value |= 1 << b;
+	}
+	return value;
+}
+
+// XTAL1 rising edge loads the bus by XA1 and XA0
+void HvppTarget::strobe(const int8_t *level) {
+	uint64_t	now = hostsim::now();
+
+	if (now < t_hv + chip.t_enter * 1000ULL)
+		hostsim::violation("XTAL1 %.1fus after +12V, %uus for %s", (now - t_hv) / 1000.0, chip.t_enter, chip.name);
+	if (now < busy_until)
+		hostsim::violation("XTAL1 while RDY/#BSY is busy");
+	uint8_t	value = bus(level);
+	switch ((high(level[P_XA1]) ? 2 : 0) | (high(level[P_XA0]) ? 1 : 0)) {
+	case 0:
+		if (high(level[P_BS1]))
+			address = (address & 0x00FF) | (value << 8);
+		else
+			address = (address & 0xFF00) | value;
+		break;
+	case 1:
+		if (high(level[P_BS1]))
+			data_high = value;
+		else
+			data = value;
+		break;
+	case 2:
+		command = value;
+		commands++;
+		break;
+	}
+}
+
+// #WR falling edge writes by the loaded command
+void HvppTarget::write(const int8_t *level) {
+	bool	locked = (chip.lock & 0x03) == 0;
+
+	if (hostsim::now() < busy_until)
+		hostsim::violation("#WR while RDY/#BSY is busy");
+	writes++;
+	switch (command) {
+	case 0x80:
+		if (erase_hangs) {
+			// RDY/#BSY stays low until the power-off
+			erase_hangs--;
+			hung = true;
+			busy_gen++;
+			busy_until = UINT64_MAX;
+			hostsim::drive(P_RDY, 0);
+			break;
+		}
+		chip.erase();
+		busy(T_WLRH_CE);
+		break;
+	case 0x40:
+		// LB mode 3 locks the Fuse bytes
+		if (!locked) {
+			if (high(level[P_BS2])) {
+				if (chip.has_ext)
+					chip.fuse[2] = data & chip.ext_bits;
+			} else
+				chip.fuse[high(level[P_BS1]) ? 1 : 0] = data;
+		}
+		busy(T_WLRH);
+		break;
+	case 0x20:
+		if (!locked)
+			chip.lock &= data | 0xC0;
+		busy(T_WLRH);
+		break;
+	case 0x10:
+		// The page buffer needs PAGEL which is not wired on the shield
+		busy(T_WLRH);
+		break;
+	default:
+		hostsim::violation("#WR with the command 0x%02X", command);
+		break;
+	}
+}
+
+void HvppTarget::busy(uint32_t us) {
+	uint64_t	now = hostsim::now();
+	unsigned	gen = ++busy_gen;
+
+	busy_until = now + us * 1000ULL;
+	hostsim::drive(P_RDY, 0);
+	hostsim::at(busy_until, [this, gen]() {
+		if (gen == busy_gen && active)
+			hostsim::drive(P_RDY, 1);
+	});
+}
+
+// #OE falling edge drives the bus by the loaded command
+void HvppTarget::read(const int8_t *level) {
+	uint8_t	value = 0xFF;
+	bool	bs1 = high(level[P_BS1]), bs2 = high(level[P_BS2]);
+
+	if (hostsim::now() < busy_until)
+		hostsim::violation("#OE while RDY/#BSY is busy");
+	switch (command) {
+	case 0x04:
+		if (bs2)
+			value = bs1 ? chip.fuse[1] : (chip.fuse[2] | ~chip.ext_bits);
+		else
+			value = bs1 ? chip.lock | 0xC0 : chip.fuse[0];
+		break;
+	case 0x08:
+		if (bs1)
+			value = chip.calibration;
+		else
+			value = (address & 0xFF) < 3 ? (uint8_t)(chip.signature >> (8 * (2 - (address & 0xFF)))) : 0xFF;
+		break;
+	case 0x02:
+		value = chip.flash[((uint32_t)address * 2 + (bs1 ? 1 : 0)) % chip.flash_bytes];
+		break;
+	case 0x03:
+		value = chip.eeprom[address % chip.eeprom_bytes];
+		break;
+	default:
+		hostsim::violation("#OE with the command 0x%02X", command);
+		break;
+	}
+	for (int b = 0; b < 8; b++)
+		hostsim::drive(P_DATA[b], value & (1 << b) ? 1 : 0);
+	driving = true;
+}
+
+// Serial programming
+void IspTarget::pins(const int8_t *level) {
+	// RESET has the pull-up of the target
+	bool	low = level[P_RESET] == 0;
+
+	sense_mode(level);
+	if (low && !reset) {
+		t_reset = hostsim::now();
+		index = 0;
+		framed = true;
+	} else if (!low && reset)
+		enabled = false;
+	reset = low;
+}
+
+uint8_t IspTarget::spi(uint8_t mosi, uint32_t sck_hz) {
+	uint32_t	fck = chip.fck();
+	uint8_t		miso;
+
+	if (!reset)
+		return 0xFF;
+	sck = sck_hz;
+	// SCK high and low periods must be over 2 clocks of the target, and
+	// over 3 clocks from 12MHz
+	if ((uint64_t)sck_hz * 4 > fck)
+		framed = false;
+	if (!framed)
+		return (uint8_t)(mosi * 0x9D + index++ * 0x3B);
+	miso = index == 3 ? response() : (index ? frame[index - 1] : out);
+	if ((uint64_t)sck_hz * 4 == fck || (fck >= 12000000UL && (uint64_t)sck_hz * 6 > fck)) {
+		if (++marginal == MARGINAL) {
+			marginal = 0;
+			miso ^= 0x01;
+			corrupted++;
+		}
+	}
+	frame[index++] = mosi;
+	if (index == 4) {
+		execute();
+		index = 0;
+	}
+	return out = miso, miso;
+}
+
+// The fourth byte of the instruction
+uint8_t IspTarget::response(void) {
+	uint32_t	addr = frame[1] << 8 | frame[2];
+	uint8_t		echo = frame[2];
+
+	if (!enabled)
+		return echo;
+	switch (frame[0]) {
+	case 0x20:
+	case 0x28:
+		// Data polling, a location reads 0xFF while it is programmed
+		if (hostsim::now() < busy_until)
+			return 0xFF;
+		return chip.flash[(addr * 2 + (frame[0] == 0x28)) % chip.flash_bytes];
+	case 0xA0:
+		if (hostsim::now() < busy_until)
+			return 0xFF;
+		return chip.eeprom[addr % chip.eeprom_bytes];
+	case 0x30:
+		return frame[2] < 3 ? (uint8_t)(chip.signature >> (8 * (2 - frame[2]))) : 0xFF;
+	case 0x38:
+		return chip.calibration;
+	case 0x50:
+		return frame[1] == 0x08 ? (uint8_t)(chip.fuse[2] | ~chip.ext_bits) : chip.fuse[0];
+	case 0x58:
+		return frame[1] == 0x08 ? chip.fuse[1] : (uint8_t)(chip.lock | 0xC0);
+	case 0xF0:
+		// The part without the poll instruction just echoes
+		if (chip.has_poll)
+			return hostsim::now() < busy_until ? 0x01 : 0x00;
+		return echo;
+	}
+	return echo;
+}
+
+void IspTarget::execute(void) {
+	uint64_t	now = hostsim::now();
+	uint32_t	addr = frame[1] << 8 | frame[2];
+	bool		locked = (chip.lock & 0x03) == 0;
+
+	if (frame[0] == 0xAC && frame[1] == 0x53) {
+		if (now < t_reset + T_RST * 1000ULL)
+			hostsim::violation("Programming Enable %.1fms after RESET", (now - t_reset) / 1e6);
+		else if (!enabled) {
+			enabled = true;
+			enables++;
+			page.assign(chip.page_bytes, 0xFF);
+			eepage.assign(chip.eepage_bytes, 0xFF);
+			eepage_loaded.assign(chip.eepage_bytes, false);
+		}
+		return;
+	}
+	if (!enabled) {
+		hostsim::violation("instruction 0x%02X before Programming Enable", frame[0]);
+		return;
+	}
+	instructions++;
+	if (frame[0] == 0xF0) {
+		if (!chip.has_poll)
+			hostsim::violation("Poll RDY/#BSY is not an instruction of %s", chip.name);
+		polls++;
+		return;
+	}
+	if (now < busy_until && (frame[0] == 0x20 || frame[0] == 0x28 || frame[0] == 0xA0)) {
+		data_polls++;
+		return;
+	}
+	if (now < busy_until) {
+		hostsim::violation("instruction %02X %02X %02X while busy", frame[0], frame[1], frame[2]);
+		return;
+	}
+	switch (frame[0]) {
+	case 0xAC:
+		switch (frame[1]) {
+		case 0x80:
+			chip.erase();
+			busy_until = now + chip.t_wd_erase * 1000ULL;
+			return;
+		case 0xA0:
+		case 0xA8:
+		case 0xA4:
+			if (frame[1] == 0xA4 && !chip.has_ext)
+				break;
+			if (!locked) {
+				if (frame[1] == 0xA4)
+					chip.fuse[2] = frame[3] & chip.ext_bits;
+				else
+					chip.fuse[frame[1] == 0xA8 ? 1 : 0] = frame[3];
+			}
+			busy_until = now + chip.t_wd_fuse * 1000ULL;
+			return;
+		case 0xE0:
+			if (!locked)
+				chip.lock &= frame[3] | 0xC0;
+			busy_until = now + chip.t_wd_fuse * 1000ULL;
+			return;
+		}
+		break;
+	case 0x40:
+	case 0x48:
+		page[(addr * 2 + (frame[0] == 0x48)) % chip.page_bytes] = frame[3];
+		return;
+	case 0x4C: {
+		// The page is programmed into the erased Flash, it can not turn a bit to 1
+		uint32_t	top = (addr * 2) & ~(uint32_t)(chip.page_bytes - 1);
+		if (top >= chip.flash_bytes) {
+			hostsim::violation("Flash page 0x%04X is out of %s", top, chip.name);
+			return;
+		}
+		for (uint16_t i = 0; i < chip.page_bytes; i++)
+			chip.flash[top + i] &= page[i];
+		page.assign(chip.page_bytes, 0xFF);
+		busy_until = now + chip.t_wd_flash * 1000ULL;
+		return;
+	}
+	case 0xC0:
+		if (addr >= chip.eeprom_bytes) {
+			hostsim::violation("EEPROM 0x%04X is out of %s", addr, chip.name);
+			return;
+		}
+		chip.eeprom[addr] = frame[3];
+		busy_until = now + chip.t_wd_eeprom * 1000ULL;
+		return;
+	case 0xC1:
+		if (!chip.has_eepage)
+			break;
+		eepage[frame[2] % chip.eepage_bytes] = frame[3];
+		eepage_loaded[frame[2] % chip.eepage_bytes] = true;
+		return;
+	case 0xC2: {
+		if (!chip.has_eepage)
+			break;
+		uint32_t	top = addr & ~(uint32_t)(chip.eepage_bytes - 1);
+		for (uint16_t i = 0; i < chip.eepage_bytes; i++)
+			if (eepage_loaded[i] && top + i < chip.eeprom_bytes)
+				chip.eeprom[top + i] = eepage[i];
+		eepage_loaded.assign(chip.eepage_bytes, false);
+		busy_until = now + chip.t_wd_eeprom * 1000ULL;
+		return;
+	}
+	case 0x20:
+	case 0x28:
+	case 0xA0:
+	case 0x30:
+	case 0x38:
+	case 0x50:
+	case 0x58:
+		return;
+	}
+	hostsim::violation("%02X %02X is not an instruction of %s", frame[0], frame[1], chip.name);
+}
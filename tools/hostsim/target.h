@@ -0,0 +1,108 @@
+#ifndef	__TARGET_H_
+#define	__TARGET_H_
+
+//	target.h
+//	This sketch licensed under the MIT License (MIT)
+//	Copyright (c) 2015 hieromon@gmail.com
+//
+//	Models of the target chip for the host simulation. The high-voltage
+//	parallel programming and the serial programming of the ATmega328P
+//	and the ATmega8 are modelled by the datasheet, each departure from
+//	the datasheet timing or sequence is reported as a violation.
+
+#include "hostsim.h"
+
+// Memories and the Fuse bytes of a target chip
+struct Chip {
+	const char	*name;
+	uint32_t	signature;
+	uint8_t		calibration;
+	uint8_t		fuse[3];				// Low, high and extended
+	uint8_t		ext_bits;				// Implemented bits of the extended Fuse
+	uint8_t		lock;
+	bool		has_ext;				// The extended Fuse exists
+	bool		has_poll;				// Poll RDY/#BSY 0xF0 of the serial programming
+	bool		has_eepage;				// EEPROM page 0xC1/0xC2 of the serial programming
+	uint32_t	flash_bytes;
+	uint16_t	page_bytes;
+	uint16_t	eeprom_bytes;
+	uint16_t	eepage_bytes;
+	// Self-timed waits of the serial programming by microseconds
+	uint32_t	t_wd_fuse, t_wd_flash, t_wd_eeprom, t_wd_erase;
+	// Parallel programming, VCC to +12V window and +12V to the first command
+	uint32_t	t_vcc_min, t_vcc_max, t_enter;
+	std::vector<uint8_t>	flash, eeprom;
+
+	static Chip	atmega328p(void);
+	static Chip	atmega8(void);
+	// System clock of the chip by its low Fuse
+	uint32_t	fck(void) const;
+	void		erase(void);
+};
+
+// The board of FuseRescue or ArduinoISP, the mode select pin A0 follows
+// the board while the Uno senses it with VCC on.
+class Board : public hostsim::Target {
+public:
+	explicit Board(Chip &chip, bool fuserescue) : chip(chip), fuserescue(fuserescue) {}
+	Chip	&chip;
+protected:
+	// The mode select pin is driven while VCC is on for the first time
+	void	sense_mode(const int8_t *level);
+	bool	fuserescue;
+	bool	sensing = false, sensed = false;
+};
+
+// High-voltage parallel programming on the FuseRescue shield
+class HvppTarget : public Board {
+public:
+	explicit HvppTarget(Chip &chip) : Board(chip, true) {}
+	void	pins(const int8_t *level) override;
+	uint32_t	commands = 0;			// Commands which have been loaded
+	uint32_t	writes = 0;				// #WR pulses
+	uint32_t	power_ups = 0;			// Entries to the programming mode
+	uint32_t	erase_hangs = 0;		// Chip erases which never end until the power-off
+	bool	programming(void) const { return hostsim::now() < busy_until; }
+private:
+	void	enter(const int8_t *level);
+	void	leave(void);
+	void	strobe(const int8_t *level);
+	void	write(const int8_t *level);
+	void	read(const int8_t *level);
+	void	busy(uint32_t us);
+	uint8_t	bus(const int8_t *level);
+	int8_t	last[hostsim::PINS];
+	bool	vcc = false, hv = false, active = false, hung = false;
+	uint64_t	t_vcc = 0, t_hv = 0, t_wr = 0, busy_until = 0;
+	unsigned	busy_gen = 0;
+	uint8_t	command = 0, data = 0, data_high = 0;
+	uint16_t	address = 0;
+	bool	driving = false;
+};
+
+// Serial programming on the ISP header
+class IspTarget : public Board {
+public:
+	explicit IspTarget(Chip &chip) : Board(chip, false) {}
+	void	pins(const int8_t *level) override;
+	uint8_t	spi(uint8_t mosi, uint32_t sck_hz) override;
+	uint32_t	instructions = 0;		// Instructions which have been executed
+	uint32_t	polls = 0;				// Poll RDY/#BSY instructions
+	uint32_t	data_polls = 0;			// Reads of the memory while busy
+	uint32_t	corrupted = 0;			// Bytes corrupted by the marginal SCK
+	uint32_t	enables = 0;			// Accepted Programming Enable
+	uint32_t	sck = 0;				// SCK of the last byte (Hz)
+private:
+	void	execute(void);
+	uint8_t	response(void);
+	bool	reset = true;
+	bool	enabled = false;
+	bool	framed = true;				// The byte framing is kept
+	uint64_t	t_reset = 0, busy_until = 0;
+	uint8_t	frame[4] = { 0, 0, 0, 0 };
+	uint8_t	index = 0, out = 0, marginal = 0;
+	std::vector<uint8_t>	page, eepage;
+	std::vector<bool>	page_loaded, eepage_loaded;
+};
+
+#endif	/* __TARGET_H_ */
@@ -0,0 +1,515 @@
+//	ispfarm.cpp
+//	This sketch licensed under the MIT License (MIT)
+//	Copyright (c) 2015 hieromon@gmail.com
+//
+//	Host driver which runs many ISPFuseRescue programmers at once on Linux.
+//	Each serial port has its worker thread, and the workers take the jobs
+//	from one queue, so that the throughput scales with the number of the
+//	programmers attached.
+//	- ArduinoISP mode writes a raw binary image into the Flash by STK500v1,
+//	  and verifies it by the on-device CRC command 'z'. The image is memory
+//	  mapped and shared by all the workers.
+//	- FuseRescue mode sends the operations as a binary protocol frame and
+//	  checks the status of each operation.
+//	Any tty can be the port, such as /dev/ttyACM0 or a pseudo-terminal.
+//
+//	build: g++ -std=c++17 -O2 -pthread -o ispfarm tools/ispfarm.cpp
+//	usage: ispfarm [options] PORT...
+//		-i IMAGE	Write IMAGE to the Flash with ArduinoISP
+//		-f OPS		FuseRescue operations, e.g. "V,R" or "V,L=62,H=D9"
+//		-p BYTES	Flash page size in bytes, default 128
+//		-n JOBS		Number of the jobs, default one per port
+//		-b BAUD		Baud rate, default 19200 for ArduinoISP and 9600 for FuseRescue
+//		-w MS		Wait after the port opened while the board resets, default 2000
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+// STK500v1 tokens which ArduinoISP speaks
+#define STK_OK			0x10
+#define STK_INSYNC		0x14
+#define CRC_EOP			0x20
+#define STK_READ_CRC	0x7A
+
+// FuseRescue binary protocol
+#define FRAME_STX		0x02
+#define FRAME_MAX		64
+static const uint32_t	FUSERESCUE_BAUD_RATES[] = {
+	9600, 19200, 38400, 57600, 115200, 250000, 500000, 1000000
+};
+
+// Serial port in the raw mode, the reading is bounded by the time-out
+class SerialPort {
+public:
+	SerialPort(const std::string &path, uint32_t baud) : path(path) {
+		fd = ::open(path.c_str(), O_RDWR | O_NOCTTY);
+		if (fd < 0)
+			throw std::runtime_error(path + ": " + strerror(errno));
+		speed(baud);
+	}
+	~SerialPort() {
+		::close(fd);
+	}
+	SerialPort(const SerialPort &) = delete;
+	SerialPort &operator=(const SerialPort &) = delete;
+
+	void speed(uint32_t baud) {
+		struct termios	tio;
+		speed_t	code = baud_code(baud);
+
+		if (tcgetattr(fd, &tio) < 0)
+			throw std::runtime_error(path + ": not a tty");
+		cfmakeraw(&tio);
+		tio.c_cflag |= CLOCAL | CREAD;
+		tio.c_cc[VMIN] = 0;
+		tio.c_cc[VTIME] = 0;
+		cfsetispeed(&tio, code);
+		cfsetospeed(&tio, code);
+		if (tcsetattr(fd, TCSANOW, &tio) < 0)
+			throw std::runtime_error(path + ": can not set " + std::to_string(baud) + " baud");
+	}
+
+	void write(const uint8_t *data, size_t len) {
+		while (len) {
+			ssize_t	n = ::write(fd, data, len);
+			if (n < 0) {
+				if (errno == EINTR || errno == EAGAIN)
+					continue;
+				throw std::runtime_error(path + ": " + strerror(errno));
+			}
+			data += n;
+			len -= n;
+		}
+	}
+	void write(std::initializer_list<uint8_t> data) {
+		std::vector<uint8_t>	v(data);
+		write(v.data(), v.size());
+	}
+
+	// A byte, -1 if nothing arrived within the time-out
+	int read(int timeout_ms = 1000) {
+		struct pollfd	p = { fd, POLLIN, 0 };
+		uint8_t	c;
+
+		if (poll(&p, 1, timeout_ms) <= 0 || ::read(fd, &c, 1) != 1)
+			return -1;
+		return c;
+	}
+	void expect(uint8_t c, const char *what) {
+		int	r = read();
+		if (r != c) {
+			char	msg[80];
+			snprintf(msg, sizeof msg, "%s: expected 0x%02X, got %s0x%02X", what, c,
+				r < 0 ? "time-out " : "", r < 0 ? 0 : r);
+			throw std::runtime_error(msg);
+		}
+	}
+	void drain(void) {
+		while (read(50) >= 0);
+	}
+
+	const std::string	path;
+
+private:
+	static speed_t baud_code(uint32_t baud) {
+		switch (baud) {
+		case 9600:		return B9600;
+		case 19200:		return B19200;
+		case 38400:		return B38400;
+		case 57600:		return B57600;
+		case 115200:	return B115200;
+		case 230400:	return B230400;
+		case 500000:	return B500000;
+		case 1000000:	return B1000000;
+		}
+		throw std::runtime_error(std::to_string(baud) + " baud is not supported by termios");
+	}
+
+	int	fd;
+};
+
+// Read-only memory mapped image
+class Image {
+public:
+	explicit Image(const std::string &path) {
+		struct stat	st;
+		int	fd = ::open(path.c_str(), O_RDONLY);
+
+		if (fd < 0 || fstat(fd, &st) < 0)
+			throw std::runtime_error(path + ": " + strerror(errno));
+		length = st.st_size;
+		if (length) {
+			void	*p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+			if (p == MAP_FAILED) {
+				::close(fd);
+				throw std::runtime_error(path + ": " + strerror(errno));
+			}
+			bytes = static_cast<const uint8_t *>(p);
+		}
+		::close(fd);
+	}
+	~Image() {
+		if (length)
+			munmap(const_cast<uint8_t *>(bytes), length);
+	}
+	Image(const Image &) = delete;
+	Image &operator=(const Image &) = delete;
+
+	const uint8_t	*bytes = nullptr;
+	size_t	length = 0;
+};
+
+// Job queue which is shared by the workers
+class JobQueue {
+public:
+	explicit JobQueue(unsigned jobs) {
+		for (unsigned i = 1; i <= jobs; i++)
+			queue.push_back(i);
+	}
+	std::optional<unsigned> take(void) {
+		std::lock_guard<std::mutex>	lock(mutex);
+		if (queue.empty())
+			return std::nullopt;
+		unsigned	job = queue.front();
+		queue.pop_front();
+		return job;
+	}
+
+private:
+	std::mutex	mutex;
+	std::deque<unsigned>	queue;
+};
+
+// Settings of the run
+struct Options {
+	std::string	image;
+	std::vector<uint8_t>	ops;
+	std::vector<std::string>	ports;
+	unsigned	page = 128;
+	unsigned	jobs = 0;
+	uint32_t	baud = 0;
+	unsigned	reset_wait = 2000;
+};
+
+// Result of a port
+struct PortStats {
+	unsigned	done = 0;
+	unsigned	failed = 0;
+	uint64_t	bytes = 0;
+	double	seconds = 0;
+};
+
+// Output lines of the workers are not interleaved
+static std::mutex	LOG_MUTEX;
+static void report(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static void report(const char *fmt, ...) {
+	std::lock_guard<std::mutex>	lock(LOG_MUTEX);
+	va_list	ap;
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	fflush(stdout);
+}
+
+static uint32_t crc32(const uint8_t *data, size_t len) {
+	uint32_t	crc = 0xFFFFFFFF;
+
+	while (len--) {
+		crc ^= *data++;
+		for (int i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320 : 0);
+	}
+	return ~crc;
+}
+
+// Synchronize with ArduinoISP, the first bytes may be lost while the
+// bootloader is running.
+static void isp_sync(SerialPort &port) {
+	for (int i = 0; i < 10; i++) {
+		port.write({ '0', CRC_EOP });
+		if (port.read(200) == STK_INSYNC && port.read() == STK_OK)
+			return;
+		port.drain();
+	}
+	throw std::runtime_error("no response from ArduinoISP");
+}
+
+// Send a command which is replied by STK_INSYNC, STK_OK
+static void isp_command(SerialPort &port, const std::vector<uint8_t> &cmd, const char *what) {
+	port.write(cmd.data(), cmd.size());
+	port.expect(STK_INSYNC, what);
+	port.expect(STK_OK, what);
+}
+
+// Write and verify the image, the returned value is the written bytes
+static uint64_t isp_job(SerialPort &port, const Image &image, const Options &opt) {
+	size_t	flash = image.length;
+	std::vector<uint8_t>	cmd;
+
+	isp_sync(port);
+	// STK_SET_DEVICE, only the page size matters to ArduinoISP
+	cmd = { 'B', 0x86, 0, 0, 1, 1, 1, 1, 3, 0xFF, 0xFF, 0xFF, 0xFF,
+		(uint8_t)(opt.page >> 8), (uint8_t)opt.page, 0x04, 0x00,
+		(uint8_t)(flash >> 24), (uint8_t)(flash >> 16), (uint8_t)(flash >> 8), (uint8_t)flash,
+		CRC_EOP };
+	isp_command(port, cmd, "set device");
+	isp_command(port, { 'E', 5, 4, 0xD7, 0xC2, 0, CRC_EOP }, "set device ext");
+	isp_command(port, { 'P', CRC_EOP }, "enter progmode");
+	// Chip erase by the universal command, it lets ArduinoISP skip the blank pages
+	port.write({ 'V', 0xAC, 0x80, 0x00, 0x00, CRC_EOP });
+	port.expect(STK_INSYNC, "chip erase");
+	port.read();
+	port.expect(STK_OK, "chip erase");
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+	// Program each page, the last page is padded by 0xFF
+	for (size_t addr = 0; addr < image.length; addr += opt.page) {
+		size_t	len = std::min<size_t>(opt.page, image.length - addr);
+		size_t	word = addr / 2;
+
+		isp_command(port, { 'U', (uint8_t)word, (uint8_t)(word >> 8), CRC_EOP }, "load address");
+		cmd = { 'd', (uint8_t)(opt.page >> 8), (uint8_t)opt.page, 'F' };
+		cmd.insert(cmd.end(), image.bytes + addr, image.bytes + addr + len);
+		cmd.resize(4 + opt.page, 0xFF);
+		cmd.push_back(CRC_EOP);
+		isp_command(port, cmd, "program page");
+	}
+
+	// Verify by CRC-32 on the programmer
+	size_t	len = image.length;
+	port.write({ STK_READ_CRC, 'F', 4, 0, 0, 0, 0,
+		(uint8_t)(len >> 24), (uint8_t)(len >> 16), (uint8_t)(len >> 8), (uint8_t)len, CRC_EOP });
+	port.expect(STK_INSYNC, "read crc");
+	uint32_t	crc = 0;
+	for (int i = 0; i < 4; i++) {
+		int	c = port.read(5000);
+		if (c < 0)
+			throw std::runtime_error("read crc: time-out");
+		crc = (crc << 8) | c;
+	}
+	port.expect(STK_OK, "read crc");
+	if (crc != crc32(image.bytes, image.length))
+		throw std::runtime_error("verify: CRC mismatch");
+	isp_command(port, { 'Q', CRC_EOP }, "leave progmode");
+	return image.length;
+}
+
+// Data length of the result of each FuseRescue operation
+static size_t fuse_result_length(uint8_t op) {
+	switch (op) {
+	case 'V':	return 3;
+	case 'R':	return 4;
+	case 'L': case 'H': case 'X': case 'K': case 'S':	return 1;
+	case 'W': case 'A':	return 3;
+	case 'T':	return 10;
+	}
+	return 0;
+}
+
+// Send the operations by a frame and check the response
+static uint64_t fuse_job(SerialPort &port, const Options &opt, std::string &result) {
+	std::vector<uint8_t>	frame = { FRAME_STX, (uint8_t)opt.ops.size() };
+	uint8_t	sum = (uint8_t)opt.ops.size();
+
+	for (uint8_t c : opt.ops)
+		sum += c;
+	frame.insert(frame.end(), opt.ops.begin(), opt.ops.end());
+	frame.push_back((uint8_t)-sum);
+	port.drain();
+	port.write(frame.data(), frame.size());
+
+	// The terminal text is skipped until the response frame starts
+	int	c;
+	while ((c = port.read(5000)) != FRAME_STX)
+		if (c < 0)
+			throw std::runtime_error("no response frame");
+	int	len = port.read();
+	if (len <= 0)
+		throw std::runtime_error("response frame: time-out");
+	std::vector<uint8_t>	res;
+	sum = (uint8_t)len;
+	for (int i = 0; i <= len; i++) {
+		if ((c = port.read(5000)) < 0)
+			throw std::runtime_error("response frame: time-out");
+		res.push_back((uint8_t)c);
+		sum += (uint8_t)c;
+	}
+	if (sum)
+		throw std::runtime_error("response frame: checksum mismatch");
+	if (res[0])
+		throw std::runtime_error("request frame was refused, NAK " + std::to_string(res[0]));
+
+	// Each result is the operation, the status and its data
+	char	hex[4];
+	for (size_t i = 1; i + 2 < res.size(); ) {
+		uint8_t	op = res[i], status = res[i + 1];
+		size_t	n = status ? 0 : fuse_result_length(op);
+		result += (char)op;
+		result += ':';
+		for (size_t k = 0; k < n && i + 2 + k < res.size() - 1; k++) {
+			snprintf(hex, sizeof hex, "%02X", res[i + 2 + k]);
+			result += hex;
+		}
+		result += ' ';
+		if (status)
+			throw std::runtime_error(result + "failed, status " + std::to_string(status));
+		// The host follows the baud rate switch after the response
+		if (op == 'S')
+			port.speed(FUSERESCUE_BAUD_RATES[res[i + 2]]);
+		i += 2 + n;
+	}
+	return opt.ops.size();
+}
+
+// Worker of a port, the jobs are taken until the queue runs out
+static void worker(const std::string &path, JobQueue &queue, const Image *image,
+		const Options &opt, PortStats &stats) {
+	try {
+		SerialPort	port(path, opt.baud);
+		std::this_thread::sleep_for(std::chrono::milliseconds(opt.reset_wait));
+		port.drain();
+		while (auto job = queue.take()) {
+			Clock::time_point	start = Clock::now();
+			std::string	result;
+			try {
+				uint64_t	bytes = image ? isp_job(port, *image, opt) : fuse_job(port, opt, result);
+				double	sec = std::chrono::duration<double>(Clock::now() - start).count();
+				stats.done++;
+				stats.bytes += bytes;
+				stats.seconds += sec;
+				if (image)
+					report("%s: job %u ok, %llu bytes in %.2fs (%.0f B/s)\n", path.c_str(), *job,
+						(unsigned long long)bytes, sec, bytes / sec);
+				else
+					report("%s: job %u ok, %s\n", path.c_str(), *job, result.c_str());
+			} catch (const std::exception &e) {
+				stats.failed++;
+				report("%s: job %u failed, %s\n", path.c_str(), *job, e.what());
+				port.drain();
+			}
+		}
+	} catch (const std::exception &e) {
+		report("%s: %s\n", path.c_str(), e.what());
+	}
+}
+
+// Operations such as "V,L=62" into the frame payload
+static std::vector<uint8_t> parse_ops(const char *arg) {
+	std::vector<uint8_t>	ops;
+	std::string	s(arg);
+	size_t	pos = 0;
+
+	while (pos < s.size()) {
+		size_t	end = s.find(',', pos);
+		std::string	tok = s.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+		pos = end == std::string::npos ? s.size() : end + 1;
+		if (tok.empty())
+			continue;
+		ops.push_back((uint8_t)toupper(tok[0]));
+		if (tok.size() > 2 && tok[1] == '=')
+			ops.push_back((uint8_t)strtoul(tok.c_str() + 2, nullptr, 16));
+	}
+	if (ops.empty() || ops.size() > FRAME_MAX)
+		throw std::runtime_error("operations must be 1 to 64 bytes");
+	return ops;
+}
+
+static void usage(void) {
+	fprintf(stderr,
+		"usage: ispfarm [-i IMAGE | -f OPS] [-p BYTES] [-n JOBS] [-b BAUD] [-w MS] PORT...\n"
+		"  -i IMAGE  write the raw binary IMAGE to the Flash with ArduinoISP\n"
+		"  -f OPS    FuseRescue operations, e.g. \"V,R\" or \"V,L=62,H=D9\"\n"
+		"  -p BYTES  Flash page size in bytes, default 128\n"
+		"  -n JOBS   number of the jobs, default one per port\n"
+		"  -b BAUD   baud rate, default 19200 (-i) or 9600 (-f)\n"
+		"  -w MS     wait for the board reset after opening the port, default 2000\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[]) {
+	Options	opt;
+	int	c;
+
+	try {
+		while ((c = getopt(argc, argv, "i:f:p:n:b:w:")) != -1) {
+			switch (c) {
+			case 'i':	opt.image = optarg;	break;
+			case 'f':	opt.ops = parse_ops(optarg);	break;
+			case 'p':	opt.page = strtoul(optarg, nullptr, 0);	break;
+			case 'n':	opt.jobs = strtoul(optarg, nullptr, 0);	break;
+			case 'b':	opt.baud = strtoul(optarg, nullptr, 0);	break;
+			case 'w':	opt.reset_wait = strtoul(optarg, nullptr, 0);	break;
+			default:	usage();
+			}
+		}
+	} catch (const std::exception &e) {
+		fprintf(stderr, "ispfarm: %s\n", e.what());
+		return 2;
+	}
+	for (int i = optind; i < argc; i++)
+		opt.ports.push_back(argv[i]);
+	if (opt.ports.empty() || opt.image.empty() == opt.ops.empty() || !opt.page || opt.page > 256)
+		usage();
+	if (!opt.jobs)
+		opt.jobs = opt.ports.size();
+	if (!opt.baud)
+		opt.baud = opt.image.empty() ? 9600 : 19200;
+
+	std::unique_ptr<Image>	image;
+	try {
+		if (!opt.image.empty())
+			image.reset(new Image(opt.image));
+	} catch (const std::exception &e) {
+		fprintf(stderr, "ispfarm: %s\n", e.what());
+		return 1;
+	}
+
+	// One worker per port, all of them share the job queue and the image
+	JobQueue	queue(opt.jobs);
+	std::vector<PortStats>	stats(opt.ports.size());
+	std::vector<std::thread>	workers;
+	Clock::time_point	start = Clock::now();
+	for (size_t i = 0; i < opt.ports.size(); i++)
+		workers.emplace_back(worker, std::cref(opt.ports[i]), std::ref(queue), image.get(),
+			std::cref(opt), std::ref(stats[i]));
+	for (auto &w : workers)
+		w.join();
+	double	elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+	// Summary of each port
+	unsigned	done = 0, failed = 0;
+	printf("%-20s %6s %6s %12s\n", "port", "done", "failed", image ? "B/s" : "jobs/s");
+	for (size_t i = 0; i < opt.ports.size(); i++) {
+		const PortStats	&s = stats[i];
+		double	rate = s.seconds > 0 ? (image ? s.bytes : s.done) / s.seconds : 0;
+		printf("%-20s %6u %6u %12.1f\n", opt.ports[i].c_str(), s.done, s.failed, rate);
+		done += s.done;
+		failed += s.failed;
+	}
+	printf("%u done, %u failed, %u not run in %.2fs\n", done, failed,
+		opt.jobs - done - failed, elapsed);
+	return failed || done < opt.jobs ? 1 : 0;
+}
@@ -0,0 +1,229 @@
+#!/usr/bin/env python3
+#	tracevcd.py
+#	This sketch licensed under the MIT License (MIT)
+#	Copyright (c) 2015 hieromon@gmail.com
+#
+#	Convert the dump of PinTrace to a VCD waveform which GTKWave and the
+#	like can display, and print the time breakdown of each phase.
+#	The dump is read from a file, or requested from the programmer with
+#	'Y' of FuseRescue or 'y' of ArduinoISP when a serial port is given.
+#	The codes are the same as libraries/PinTrace/PinTrace.h.
+#
+#	usage: tracevcd.py [-o trace.vcd] dump.bin
+#	       tracevcd.py [-o trace.vcd] [-s dump.bin] [-b baud] [--isp] -p /dev/ttyACM0
+
+import argparse
+import os
+import select
+import struct
+import sys
+import termios
+import time
+
+TRACE_MAGIC = b'\x7fTR'
+
+TRACE_GAP, TRACE_BEGIN, TRACE_END, TRACE_LINE, TRACE_SELECT, \
+	TRACE_BUS_OUT, TRACE_BUS_IN, TRACE_SPI_OUT, TRACE_SPI_IN = range(9)
+
+LINES = ['VCC', 'HV', 'XTAL1', 'WR', 'OE', 'PAGEL', 'RDY', 'RESET']
+SELECTS = ['XA1', 'XA0', 'BS1', 'BS2']		# From bit 3 to bit 0 of TRACE_SELECT
+BUSES = {TRACE_BUS_OUT: 'DATA_OUT', TRACE_BUS_IN: 'DATA_IN',
+	TRACE_SPI_OUT: 'SPI_OUT', TRACE_SPI_IN: 'SPI_IN'}
+PHASES = ['start_pgm', 'busy', 'wait_ready', 'start_pmode']
+
+# Intervals which are measured from the edges, (name, start, end)
+PULSES = [
+	('XTAL1 pulse', (TRACE_LINE, 'XTAL1', 1), (TRACE_LINE, 'XTAL1', 0)),
+	('#OE read', (TRACE_LINE, 'OE', 0), (TRACE_LINE, 'OE', 1)),
+	('RDY/#BSY busy', (TRACE_LINE, 'RDY', 0), (TRACE_LINE, 'RDY', 1)),
+	('SPI transaction', (TRACE_SPI_OUT, None, None), (TRACE_SPI_IN, None, None)),
+]
+
+BAUDS = {9600: termios.B9600, 19200: termios.B19200, 38400: termios.B38400,
+	57600: termios.B57600, 115200: termios.B115200}
+for rate in (230400, 460800, 500000, 1000000):
+	if hasattr(termios, 'B%d' % rate):
+		BAUDS[rate] = getattr(termios, 'B%d' % rate)
+
+
+def request(port, baud, isp, timeout=3.0):
+	"""Request the dump from the programmer and return the raw bytes"""
+	if baud not in BAUDS:
+		sys.exit('%d baud is not supported' % baud)
+	fd = os.open(port, os.O_RDWR | os.O_NOCTTY)
+	try:
+		attr = termios.tcgetattr(fd)
+		attr[0] = termios.IGNPAR
+		attr[1] = 0
+		attr[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+		attr[3] = 0
+		attr[4] = attr[5] = BAUDS[baud]
+		attr[6][termios.VMIN] = 0
+		attr[6][termios.VTIME] = 0
+		termios.tcsetattr(fd, termios.TCSANOW, attr)
+		termios.tcflush(fd, termios.TCIOFLUSH)
+		os.write(fd, b'y ' if isp else b'Y\r')
+		data = b''
+		limit = time.time() + timeout
+		while time.time() < limit:
+			ready, _, _ = select.select([fd], [], [], 0.1)
+			if ready:
+				data += os.read(fd, 4096)
+				at = data.find(TRACE_MAGIC)
+				if at >= 0 and len(data) >= at + 5:
+					count = data[at + 3] | data[at + 4] << 8
+					if len(data) >= at + 5 + count * 4:
+						return data
+		sys.exit('%s: no trace is received' % port)
+	finally:
+		os.close(fd)
+
+
+def parse(data):
+	"""Decode the records to the events of (microseconds, kind, value)"""
+	at = data.find(TRACE_MAGIC)
+	if at < 0:
+		sys.exit('dump does not contain a trace')
+	count = data[at + 3] | data[at + 4] << 8
+	body = data[at + 5:at + 5 + count * 4]
+	if len(body) < count * 4:
+		sys.exit('dump is truncated, %d records of %d' % (len(body) // 4, count))
+	events = []
+	now = low = None
+	periods = 0
+	for stamp, kind, value in struct.iter_unpack('<HBB', body):
+		if kind == TRACE_GAP:
+			if now is None:
+				now, low = 0, stamp
+			periods += value
+			continue
+		if now is None:
+			now = 0
+		else:
+			now += periods * 65536 + ((stamp - low) & 0xFFFF)
+		low = stamp
+		periods = 0
+		events.append((now, kind, value))
+	return events
+
+
+def signals():
+	"""VCD identifiers and widths of all signals"""
+	sig = []
+	for name in LINES + SELECTS:
+		sig.append((name, 1))
+	for name in BUSES.values():
+		sig.append((name, 8))
+	sig.append(('PHASE', 8))
+	return {name: (chr(33 + n), width) for n, (name, width) in enumerate(sig)}
+
+
+def vcd_value(code, width, value):
+	if width == 1:
+		return '%s%s' % (value, code)
+	return 'b%s %s' % (value if value == 'x' else format(value, 'b'), code)
+
+
+def write_vcd(out, events):
+	sig = signals()
+	out.write('$comment PinTrace $end\n$timescale 1us $end\n$scope module pintrace $end\n')
+	for name, (code, width) in sig.items():
+		out.write('$var wire %d %s %s $end\n' % (width, code, name))
+	out.write('$upscope $end\n$enddefinitions $end\n#0\n$dumpvars\n')
+	for name, (code, width) in sig.items():
+		out.write(vcd_value(code, width, 'x') + '\n')
+	out.write('$end\n')
+	stamp = None
+	for t, kind, value in events:
+		changes = []
+		if kind == TRACE_LINE and value >> 1 < len(LINES):
+			changes.append((LINES[value >> 1], value & 1))
+		elif kind == TRACE_SELECT:
+			for n, name in enumerate(SELECTS):
+				changes.append((name, value >> (3 - n) & 1))
+		elif kind in BUSES:
+			changes.append((BUSES[kind], value))
+		elif kind == TRACE_BEGIN:
+			changes.append(('PHASE', value))
+		elif kind == TRACE_END:
+			changes.append(('PHASE', 'x'))
+		if not changes:
+			continue
+		if t != stamp:
+			out.write('#%d\n' % t)
+			stamp = t
+		for name, level in changes:
+			code, width = sig[name]
+			out.write(vcd_value(code, width, level) + '\n')
+
+
+def matches(event, pattern):
+	kind, line, level = pattern
+	if event[1] != kind:
+		return False
+	if line is None:
+		return True
+	return event[2] == (LINES.index(line) << 1 | level)
+
+
+def breakdown(events):
+	"""Total, count and the longest of each phase and pulse"""
+	table = {}
+
+	def add(name, span):
+		total, count, longest = table.get(name, (0, 0, 0))
+		table[name] = (total + span, count + 1, max(longest, span))
+
+	begin = {}
+	for t, kind, value in events:
+		if kind == TRACE_BEGIN:
+			begin[value] = t
+		elif kind == TRACE_END and value in begin:
+			name = PHASES[value] if value < len(PHASES) else 'phase %d' % value
+			add(name, t - begin.pop(value))
+	for name, start, end in PULSES:
+		since = None
+		for event in events:
+			if matches(event, start):
+				since = event[0]
+			elif since is not None and matches(event, end):
+				add(name, event[0] - since)
+				since = None
+	return table
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Convert the dump of PinTrace to VCD')
+	parser.add_argument('dump', nargs='?', help='dump file')
+	parser.add_argument('-p', '--port', help='request the dump from the programmer on the port')
+	parser.add_argument('-b', '--baud', type=int, default=9600, help='baud rate of the port')
+	parser.add_argument('--isp', action='store_true', help='the programmer runs ArduinoISP')
+	parser.add_argument('-s', '--save', help='save the received dump to the file')
+	parser.add_argument('-o', '--output', help='VCD file to write')
+	args = parser.parse_args()
+	if args.port:
+		data = request(args.port, args.baud, args.isp)
+		if args.save:
+			with open(args.save, 'wb') as f:
+				f.write(data)
+	elif args.dump:
+		with open(args.dump, 'rb') as f:
+			data = f.read()
+	else:
+		parser.error('a dump file or a port is required')
+
+	events = parse(data)
+	if args.output:
+		with open(args.output, 'w', newline='\n') as f:
+			write_vcd(f, events)
+	span = events[-1][0] - events[0][0] if events else 0
+	print('%d events over %d us' % (len(events), span))
+	table = breakdown(events)
+	if table:
+		print('%-16s %10s %6s %8s %8s' % ('', 'total us', 'count', 'avg us', 'max us'))
+		for name, (total, count, longest) in sorted(table.items(), key=lambda r: -r[1][0]):
+			print('%-16s %10d %6d %8.1f %8d' % (name, total, count, total / count, longest))
+
+
+if __name__ == '__main__':
+	main()